@@ -0,0 +1,171 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "animation.h"
+
+static const Keyframe startupAnimation[] =
+{
+    show(0x0001, maxLedLevel, 80),
+    show(0x0002, maxLedLevel, 80),
+    show(0x0004, maxLedLevel, 80),
+    show(0x0008, maxLedLevel, 80),
+    show(0x0010, maxLedLevel, 80),
+    show(0x1000, maxLedLevel, 80),
+    show(0x0800, maxLedLevel, 80),
+    show(0x0400, maxLedLevel, 80),
+    show(0x0200, maxLedLevel, 80),
+    show(0x0100, maxLedLevel, 80),
+    show(0x0200, maxLedLevel, 80),
+    show(0x0400, maxLedLevel, 80),
+    show(0x0800, maxLedLevel, 80),
+    show(0x1000, maxLedLevel, 80),
+    show(0x0010, maxLedLevel, 80),
+    show(0x0008, maxLedLevel, 80),
+    show(0x0004, maxLedLevel, 80),
+    show(0x0002, maxLedLevel, 80),
+    show(0x0001, maxLedLevel, 80),
+
+    // Turn all on for a moment
+    show(0x1F1F, maxLedLevel, 400),
+    end(),
+};
+
+// Sweep outward from the center of one wing
+static const Keyframe turnLeftAnimation[] =
+{
+    loop(),
+        show(0x0010, maxLedLevel, 60),
+        show(0x0018, maxLedLevel, 60),
+        show(0x001C, maxLedLevel, 60),
+        show(0x001E, maxLedLevel, 60),
+        show(0x001F, maxLedLevel, 60),
+        show(0x0000, 0, 300),
+    endLoop(),
+    end(),
+};
+
+static const Keyframe turnRightAnimation[] =
+{
+    loop(),
+        show(0x1000, maxLedLevel, 60),
+        show(0x1800, maxLedLevel, 60),
+        show(0x1C00, maxLedLevel, 60),
+        show(0x1E00, maxLedLevel, 60),
+        show(0x1F00, maxLedLevel, 60),
+        show(0x0000, 0, 300),
+    endLoop(),
+    end(),
+};
+
+static const Keyframe hazardAnimation[] =
+{
+    loop(),
+        show(0x1F1F, maxLedLevel, 400),
+        show(0x0000, 0, 400),
+    endLoop(),
+    end(),
+};
+
+// Fill from the outside in, then flash until the host stops it
+static const Keyframe shiftLightAnimation[] =
+{
+    show(0x0101, maxLedLevel, 30),
+    show(0x0303, maxLedLevel, 30),
+    show(0x0707, maxLedLevel, 30),
+    show(0x0F0F, maxLedLevel, 30),
+    loop(),
+        show(0x1F1F, maxLedLevel, 50),
+        show(0x0000, 0, 50),
+    endLoop(),
+    end(),
+};
+
+static const Keyframe* getAnimation(AnimationId id)
+{
+    switch (id)
+    {
+        case AnimationId::Startup: return startupAnimation;
+        case AnimationId::TurnLeft: return turnLeftAnimation;
+        case AnimationId::TurnRight: return turnRightAnimation;
+        case AnimationId::Hazard: return hazardAnimation;
+        case AnimationId::ShiftLight: return shiftLightAnimation;
+        default: return nullptr;
+    }
+}
+
+void AnimationPlayer::Start(AnimationId id)
+{
+    m_anim = getAnimation(id);
+    m_index = 0;
+    m_frameStart = chVTGetSystemTimeX();
+    m_loopStart = 0;
+    m_loopRemaining = 0;
+    m_current = {};
+}
+
+void AnimationPlayer::Stop()
+{
+    m_anim = nullptr;
+}
+
+bool AnimationPlayer::Update(LedFrame& out)
+{
+    // Bound the work per call, so a loop with no Show in it can't hang the main loop
+    for (size_t steps = 0; m_anim && steps < 32; steps++)
+    {
+        const Keyframe& kf = m_anim[m_index];
+
+        if (kf.op == KeyframeOp::Show)
+        {
+            sysinterval_t duration = TIME_MS2I(10 * kf.duration);
+            systime_t now = chVTGetSystemTimeX();
+            sysinterval_t elapsed = chTimeDiffX(m_frameStart, now);
+
+            if (elapsed < duration)
+            {
+                m_current = { kf.left, kf.right, kf.level };
+                break;
+            }
+
+            // Advance by exactly the frame's duration so timing doesn't drift with loop jitter,
+            // unless we're so far behind (ie, we were asleep) that it's better to start fresh
+            if (elapsed >= 2 * duration)
+            {
+                m_frameStart = now;
+            }
+            else
+            {
+                m_frameStart += duration;
+            }
+
+            m_index++;
+        }
+        else if (kf.op == KeyframeOp::LoopStart)
+        {
+            m_loopStart = m_index + 1;
+            m_loopRemaining = kf.duration;
+            m_index++;
+        }
+        else if (kf.op == KeyframeOp::LoopEnd)
+        {
+            // A count of zero loops forever
+            if (m_loopRemaining == 0 || --m_loopRemaining > 0)
+            {
+                m_index = m_loopStart;
+            }
+            else
+            {
+                m_index++;
+            }
+        }
+        else
+        {
+            // End of the animation
+            m_anim = nullptr;
+        }
+    }
+
+    // If we ran out of steps, keep showing the last frame until next time
+    out = m_current;
+    return IsPlaying();
+}
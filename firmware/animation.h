@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ch.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Brightness levels run from 0 (off) to this (full)
+static constexpr uint8_t maxLedLevel = 15;
+
+enum class KeyframeOp : uint8_t
+{
+    // Show some LEDs for a while
+    Show,
+    // Start of a block to repeat. Repeat count is in duration, 0 repeats forever.
+    LoopStart,
+    // Jump back to the matching LoopStart. Loops don't nest.
+    LoopEnd,
+    // Animation is over, hand the LEDs back to the host
+    End,
+};
+
+// One step of an animation, 5 bytes in flash
+struct Keyframe
+{
+    KeyframeOp op;
+    uint8_t left;
+    uint8_t right;
+    uint8_t level;
+    // In units of 10ms
+    uint8_t duration;
+};
+
+// Show the packed LEDs (low byte left wing, high byte right) at a brightness level for some number of milliseconds
+constexpr Keyframe show(uint16_t leds, uint8_t level, uint16_t ms)
+{
+    return { KeyframeOp::Show, static_cast<uint8_t>(leds & 0xFF), static_cast<uint8_t>(leds >> 8), level, static_cast<uint8_t>(ms / 10) };
+}
+
+constexpr Keyframe loop(uint8_t count = 0)
+{
+    return { KeyframeOp::LoopStart, 0, 0, 0, count };
+}
+
+constexpr Keyframe endLoop()
+{
+    return { KeyframeOp::LoopEnd, 0, 0, 0, 0 };
+}
+
+constexpr Keyframe end()
+{
+    return { KeyframeOp::End, 0, 0, 0, 0 };
+}
+
+// Animations the host can trigger by number
+enum class AnimationId : uint8_t
+{
+    None = 0,
+    Startup = 1,
+    TurnLeft = 2,
+    TurnRight = 3,
+    Hazard = 4,
+    ShiftLight = 5,
+};
+
+struct LedFrame
+{
+    uint8_t left;
+    uint8_t right;
+    uint8_t level;
+};
+
+class AnimationPlayer
+{
+public:
+    // Start playing an animation from the beginning, AnimationId::None stops playback
+    void Start(AnimationId id);
+    void Stop();
+
+    bool IsPlaying() const
+    {
+        return m_anim != nullptr;
+    }
+
+    // Advance to the right frame for the current time.
+    // Returns false if nothing is playing (or the animation just finished).
+    // Called from the LED update in the main loop, so it never waits.
+    bool Update(LedFrame& out);
+
+private:
+    const Keyframe* m_anim = nullptr;
+    size_t m_index = 0;
+    systime_t m_frameStart = 0;
+
+    size_t m_loopStart = 0;
+    uint8_t m_loopRemaining = 0;
+
+    LedFrame m_current = {};
+};
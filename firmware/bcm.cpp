@@ -0,0 +1,97 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "bcm.h"
+#include "wing.h"
+#include "timestamp.h"
+
+static void buildPlanes(const uint8_t (&codes)[ledsPerWing], uint8_t (&planes)[bcmBits])
+{
+    for (size_t bit = 0; bit < bcmBits; bit++)
+    {
+        uint8_t plane = 0;
+
+        for (size_t led = 0; led < ledsPerWing; led++)
+        {
+            if (codes[led] & (1 << bit))
+            {
+                plane |= 1 << led;
+            }
+        }
+
+        planes[bit] = plane;
+    }
+}
+
+void BcmDriver::SetCodes(const uint8_t (&codes)[wingCount][ledsPerWing])
+{
+    for (size_t wing = 0; wing < wingCount; wing++)
+    {
+        buildPlanes(codes[wing], m_next[wing]);
+    }
+}
+
+void BcmDriver::Service(Wings& wings)
+{
+    uint32_t now = getTimestampUs();
+
+    // Capped, so a stall (or sleep) doesn't have us switching planes early for a while after
+    uint32_t gap = now - m_lastCall;
+    if (gap > bcmLsbTimeUs)
+    {
+        gap = bcmLsbTimeUs;
+    }
+
+    m_lastCall = now;
+    m_callGap += static_cast<int32_t>(gap - m_callGap) >> 3;
+
+    // Switch once the deadline is nearer now than it will be at the next
+    // call, so switches land either side of it rather than always late
+    if (static_cast<int32_t>(m_planeEnd - now) > static_cast<int32_t>(m_callGap / 2))
+    {
+        return;
+    }
+
+    ShowNextPlane(wings, now);
+
+    // The short planes would be over before the next call, so see them out here
+    while (m_plane < bcmHeldPlanes)
+    {
+        waitUntilUs(m_planeEnd);
+        ShowNextPlane(wings, m_planeEnd);
+    }
+}
+
+void BcmDriver::ShowNextPlane(Wings& wings, uint32_t now)
+{
+    m_plane++;
+
+    if (m_plane == bcmBits)
+    {
+        m_plane = 0;
+
+        for (size_t wing = 0; wing < wingCount; wing++)
+        {
+            for (size_t i = 0; i < bcmBits; i++)
+            {
+                m_planes[wing][i] = m_next[wing][i];
+            }
+        }
+    }
+
+    // Unsigned subtraction handles the timestamp wrapping
+    m_planeEnd += bcmLsbTimeUs << m_plane;
+
+    // More than a whole plane behind (the loop stalled, or this is the first
+    // call): start the schedule over from here
+    if (static_cast<int32_t>(m_planeEnd - now) < 0)
+    {
+        m_planeEnd = now + (bcmLsbTimeUs << m_plane);
+    }
+
+    // Wing skips the write if the plane is the same as what's already showing
+    for (size_t wing = 0; wing < wingCount; wing++)
+    {
+        wings[wing].WriteLeds(m_planes[wing][m_plane]);
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "ch.h"
+
+#include "topology.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Binary code modulation: each bit of an LED's duty code gets a bit plane,
+// shown for a time proportional to the bit's weight. A full period is
+// bcmBits writes per wing no matter how many brightness levels there are.
+static constexpr size_t bcmBits = 6;
+static constexpr uint8_t bcmMaxCode = (1 << bcmBits) - 1;
+
+// Duration of the least significant plane, in microseconds. 6 bits at 200us
+// gives a 12.6ms period (~80Hz).
+static constexpr uint32_t bcmLsbTimeUs = 200;
+
+// Planes below this are too short to leave to the next Service call, so
+// Service waits them out itself and switches as soon as they're due.
+static constexpr size_t bcmHeldPlanes = 2;
+
+static constexpr size_t ledsPerWing = 5;
+
+// CIE 1931 lightness: maps perceptual brightness in [0, N) linearly to a duty code in [0, maxOut].
+// Any input above zero gets at least the smallest nonzero code, so dim isn't off.
+template <size_t N>
+constexpr std::array<uint8_t, N> makeGammaTable(uint8_t maxOut)
+{
+    std::array<uint8_t, N> table{};
+
+    for (size_t i = 0; i < N; i++)
+    {
+        float l = 100.0f * i / (N - 1);
+        float y;
+
+        if (l <= 8)
+        {
+            y = l / 903.3f;
+        }
+        else
+        {
+            float t = (l + 16) / 116;
+            y = t * t * t;
+        }
+
+        uint8_t code = static_cast<uint8_t>(y * maxOut + 0.5f);
+
+        if (i > 0 && code == 0)
+        {
+            code = 1;
+        }
+
+        table[i] = code;
+    }
+
+    return table;
+}
+
+class BcmDriver
+{
+public:
+    // Set the duty code (0 to bcmMaxCode) of each LED on each wing.
+    // Takes effect at the start of the next period, so a period never mixes two frames.
+    void SetCodes(const uint8_t (&codes)[wingCount][ledsPerWing]);
+
+    // Show the next bit plane if the current one is due to end before the
+    // next call would get to it. Cheap when nothing is due, so call it often.
+    //
+    // Plane boundaries are scheduled from the previous deadline, not from
+    // when the switch happened, so a late switch is made up by the next
+    // plane rather than adding up over the period. The weights still aren't
+    // exact: a plane can't be shorter than writing it out to every wing,
+    // about 120us per expander with LEDs on it (~470us for two wings), which
+    // is over twice the LSB. Measured in the simulator, code 1 comes out at
+    // about 2.3x its nominal duty and codes 2-3 within about 1.4x. From code
+    // 5 up the error is within about 15%, mostly from the bigger planes
+    // switching anywhere within half a call gap of their deadline.
+    //
+    // Once a period, seeing the held planes out keeps the caller for about
+    // 1.5ms of back to back wing writes.
+    void Service(Wings& wings);
+
+private:
+    // Advance to the next plane and write it to the wings
+    void ShowNextPlane(Wings& wings, uint32_t now);
+
+    // Pending planes, latched at the start of each period
+    uint8_t m_next[wingCount][bcmBits] = {};
+
+    uint8_t m_planes[wingCount][bcmBits] = {};
+
+    size_t m_plane = 0;
+    // getTimestampUs() when the current plane is due to end
+    uint32_t m_planeEnd = 0;
+
+    // Smoothed time between Service calls, at most one LSB plane
+    uint32_t m_lastCall = 0;
+    uint32_t m_callGap = 0;
+};
@@ -0,0 +1,83 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "crash.h"
+#include "report.h"
+
+struct CrashRecord
+{
+    uint32_t magic;
+    uint32_t pc;
+    uint32_t lr;
+    uint32_t xpsr;
+    uint32_t faultType;
+    // Catches RAM that happens to hold the magic after power up
+    uint32_t check;
+};
+
+static constexpr uint32_t crashMagic = 0xC4A5BEEF;
+
+// .ram0 isn't zeroed or initialized at boot, so the record survives a reset
+__attribute__((section(".ram0")))
+static CrashRecord crashRecord;
+
+enum class CrashPart : uint8_t
+{
+    Pc,
+    Lr,
+    Xpsr,
+
+    Count,
+};
+
+static ReportCursor<static_cast<size_t>(CrashPart::Count)> report;
+
+static uint32_t computeCheck(const CrashRecord& r)
+{
+    return ~(r.magic ^ r.pc ^ r.lr ^ r.xpsr ^ r.faultType);
+}
+
+void recordCrash(const port_extctx& ctx, uint8_t faultType)
+{
+    crashRecord.magic = crashMagic;
+    crashRecord.pc = ctx.pc;
+    crashRecord.lr = ctx.lr_thd;
+    crashRecord.xpsr = ctx.xpsr;
+    crashRecord.faultType = faultType;
+    crashRecord.check = computeCheck(crashRecord);
+}
+
+void checkCrashRecord()
+{
+    if (crashRecord.magic == crashMagic && crashRecord.check == computeCheck(crashRecord))
+    {
+        report.Start();
+    }
+
+    // Either way it's been seen, don't report it again next boot
+    crashRecord.magic = 0;
+}
+
+bool serviceCrashReport()
+{
+    if (!report.Active())
+    {
+        return false;
+    }
+
+    uint32_t value = 0;
+    switch (static_cast<CrashPart>(report.Index()))
+    {
+        case CrashPart::Pc: value = crashRecord.pc; break;
+        case CrashPart::Lr: value = crashRecord.lr; break;
+        case CrashPart::Xpsr: value = crashRecord.xpsr; break;
+        case CrashPart::Count: break;
+    }
+
+    // Which part, the value, then the exception number that caught it
+    DiagPayload().U8(report.Index()).U32(value).U8(crashRecord.faultType).Send(DiagType::Crash);
+
+    report.Advance();
+
+    return true;
+}
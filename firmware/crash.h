@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+struct port_extctx;
+
+// Save the faulting context where it survives a reset. Call from a fault handler, then reset.
+void recordCrash(const port_extctx& ctx, uint8_t faultType);
+
+// Check for a crash saved before the last reset, and if there is one, queue it to be reported
+void checkCrashRecord();
+
+// Send the next queued crash frame, if any. Returns true if a frame was sent.
+bool serviceCrashReport();
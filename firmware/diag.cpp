@@ -0,0 +1,25 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "diag.h"
+
+#include <cstring>
+
+void sendDiagnostic(DiagType type, const uint8_t* data, size_t size)
+{
+    if (size > 7)
+    {
+        size = 7;
+    }
+
+    CANTxFrame frame;
+    frame.SID = diagCanId;
+    frame.IDE = 0;
+    frame.RTR = 0;
+
+    frame.data8[0] = static_cast<uint8_t>(type);
+    memcpy(&frame.data8[1], data, size);
+    frame.DLC = 1 + size;
+
+    canTransmitTimeout(&CAND1, 0, &frame, TIME_IMMEDIATE);
+}
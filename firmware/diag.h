@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// All diagnostic frames share one CAN ID, the first byte says what's in the rest
+static constexpr uint32_t diagCanId = 0x743;
+
+enum class DiagType : uint8_t
+{
+    // uint32_t: microseconds from waking from STOP to sending the first button frame
+    WakeLatency = 1,
+    // uint8_t LoopPhase, then uint16_t min, max, avg in microseconds
+    LoopProfile = 2,
+    // uint8_t StackId, then uint16_t size and peak usage in bytes
+    StackUsage = 3,
+    // Sent after a reset caused by a fault. uint8_t part (0 PC, 1 LR, 2 xPSR),
+    // uint32_t value, then uint8_t exception number.
+    Crash = 4,
+    // Sent first after boot. uint8_t ResetCause, the top byte of RCC_CSR, then
+    // uint8_t 1 if it was only the watchdog waking us from sleep.
+    ResetCause = 5,
+    // Once a second. uint16_t vehicle supply mV, uint16_t lowest vehicle
+    // supply mV since the last one, uint16_t VDDA mV, then int8_t MCU
+    // temperature in C.
+    Supply = 6,
+    // uint8_t wing, uint8_t LinkStat, then uint32_t count since boot
+    LinkQuality = 7,
+};
+
+// Send a diagnostic frame, up to 7 bytes of payload
+void sendDiagnostic(DiagType type, const uint8_t* data, size_t size);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Telemetry records on the wire: [type, payload..., crc16 lo, crc16 hi],
+// COBS encoded so the only zero is the 0x00 delimiter after each record.
+// Shared with the host side decoder.
+
+// CRC-16/CCITT-FALSE
+inline uint16_t crc16(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i] << 8;
+
+        for (size_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+// Worst case encoded size of a record with this much content, including the delimiter
+constexpr size_t cobsMaxEncodedSize(size_t size)
+{
+    return size + size / 254 + 2;
+}
+
+// Decode one record, without its delimiter. Returns the decoded size, or 0 if it's malformed.
+inline size_t cobsDecode(const uint8_t* in, size_t size, uint8_t* out, size_t outSize)
+{
+    size_t written = 0;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        uint8_t code = in[i++];
+
+        if (code == 0 || i + code - 1 > size)
+        {
+            return 0;
+        }
+
+        for (size_t j = 1; j < code; j++)
+        {
+            if (written == outSize)
+            {
+                return 0;
+            }
+
+            out[written++] = in[i++];
+        }
+
+        // A short block means a zero came next, except at the very end
+        if (code < 0xFF && i < size)
+        {
+            if (written == outSize)
+            {
+                return 0;
+            }
+
+            out[written++] = 0;
+        }
+    }
+
+    return written;
+}
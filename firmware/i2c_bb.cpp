@@ -11,6 +11,10 @@
 
 #include "i2c_bb.h"
 
+#ifdef SWC_SIMULATOR
+#include "sim.h"
+#endif
+
 void BitbangI2c::sda_high()
 {
 	palSetLine(m_sda);
@@ -31,9 +35,10 @@ void BitbangI2c::scl_low()
 	palClearLine(m_scl);
 }
 
-BitbangI2c::BitbangI2c(ioline_t scl, ioline_t sda)
+BitbangI2c::BitbangI2c(ioline_t scl, ioline_t sda, I2cStats* stats)
 	: m_scl(scl)
 	, m_sda(sda)
+	, m_stats(stats)
 {
 	// Both lines idle high
 	scl_high();
@@ -105,11 +110,35 @@ bool BitbangI2c::readBit()
 
 	scl_high();
 
+#if SWC_I2C_OVERSAMPLE
+	// Sample a quarter bit apart across a longer high time and take the
+	// majority, so a spike on the line can't flip the bit on its own
+	constexpr uint8_t samples = 3;
+	uint8_t highs = 0;
+
+	for (size_t i = 0; i < samples; i++)
+	{
+		waitQuarterBit();
+
+		if (palReadLine(m_sda))
+		{
+			highs++;
+		}
+	}
+
+	bool val = 2 * highs > samples;
+
+	if (m_stats && highs != 0 && highs != samples)
+	{
+		m_stats->disagreements++;
+	}
+#else
 	waitQuarterBit();
 	waitQuarterBit();
 
 	// Read just before we set the clock low (ie, as late as possible)
 	bool val = palReadLine(m_sda);
+#endif
 
 	scl_low();
 	waitQuarterBit();
@@ -160,50 +189,119 @@ uint8_t BitbangI2c::readByte(bool ack)
 
 void BitbangI2c::waitQuarterBit()
 {
+#ifdef SWC_SIMULATOR
+	// Simulated time only moves when told to
+	sim::waitQuarterBit();
+#else
 	for (size_t i = 0; i < 6; i++)
 	{
 		__asm__ volatile ("nop");
 	}
+#endif
+}
+
+bool BitbangI2c::writeAddressByte(uint8_t addr, bool read)
+{
+	bool ack = writeByte(addr << 1 | (read ? 1 : 0));
+
+	if (!ack && m_stats)
+	{
+		m_stats->addressNacks++;
+	}
+
+	return ack;
 }
 
-void BitbangI2c::write(uint8_t addr, const uint8_t* writeData, size_t writeSize)
+bool BitbangI2c::writeDataByte(uint8_t data)
 {
+	bool ack = writeByte(data);
+
+	if (!ack && m_stats)
+	{
+		m_stats->dataNacks++;
+	}
+
+	return ack;
+}
+
+bool BitbangI2c::write(uint8_t addr, const uint8_t* writeData, size_t writeSize)
+{
+	if (m_stats)
+	{
+		m_stats->transactions++;
+	}
+
 	start();
 
-	// Address + write
-	writeByte(addr << 1 | 0);
+	// Address + write. Nobody there, nothing more to send.
+	if (!writeAddressByte(addr, false))
+	{
+		stop();
+		return false;
+	}
+
+	bool ack = true;
 
 	// Write outbound bytes
 	for (size_t i = 0; i < writeSize; i++)
 	{
-		writeByte(writeData[i]);
+		ack &= writeDataByte(writeData[i]);
 	}
 
 	stop();
+
+	return ack;
 }
 
-void BitbangI2c::writeRead(uint8_t addr, const uint8_t* writeData, size_t writeSize, uint8_t* readData, size_t readSize)
+bool BitbangI2c::writeRead(uint8_t addr, const uint8_t* writeData, size_t writeSize, uint8_t* readData, size_t readSize)
 {
+	// The read after the repeated start counts the transaction
 	start();
 
-	// Address + write
-	writeByte(addr << 1 | 0);
+	// Address + write. If nobody's there, addressing it again to read would
+	// only count the same NACK twice.
+	if (!writeAddressByte(addr, false))
+	{
+		if (m_stats)
+		{
+			m_stats->transactions++;
+		}
+
+		stop();
+
+		// What a bus with nobody on it reads as
+		for (size_t i = 0; i < readSize; i++)
+		{
+			readData[i] = 0xFF;
+		}
+
+		return false;
+	}
+
+	bool ack = true;
 
 	// Write outbound bytes
 	for (size_t i = 0; i < writeSize; i++)
 	{
-		writeByte(writeData[i]);
+		ack &= writeDataByte(writeData[i]);
 	}
 
-	read(addr, readData, readSize);
+	ack &= read(addr, readData, readSize);
+
+	return ack;
 }
 
-void BitbangI2c::read(uint8_t addr, uint8_t* readData, size_t readSize)
+bool BitbangI2c::read(uint8_t addr, uint8_t* readData, size_t readSize)
 {
+	if (m_stats)
+	{
+		m_stats->transactions++;
+	}
+
 	start();
 
 	// Address + read
-	writeByte(addr << 1 | 1);
+	bool ack = writeAddressByte(addr, true);
 
 	for (size_t i = 0; i < readSize - 1; i++)
 	{
@@ -215,6 +313,20 @@ void BitbangI2c::read(uint8_t addr, uint8_t* readData, size_t readSize)
 	readData[readSize - 1] = readByte(false);
 
 	stop();
+
+	return ack;
+}
+
+bool BitbangI2c::probe(uint8_t addr)
+{
+	start();
+
+	// Address + write, then nothing
+	bool ack = writeByte(addr << 1 | 0);
+
+	stop();
+
+	return ack;
 }
 
 uint8_t BitbangI2c::readRegister(uint8_t addr, uint8_t reg)
@@ -226,11 +338,16 @@ uint8_t BitbangI2c::readRegister(uint8_t addr, uint8_t reg)
 	return retval;
 }
 
-void BitbangI2c::writeRegister(uint8_t addr, uint8_t reg, uint8_t val)
+bool BitbangI2c::readRegister(uint8_t addr, uint8_t reg, uint8_t& val)
+{
+	return writeRead(addr, &reg, 1, &val, 1);
+}
+
+bool BitbangI2c::writeRegister(uint8_t addr, uint8_t reg, uint8_t val)
 {
 	uint8_t buf[2];
 	buf[0] = reg;
 	buf[1] = val;
 
-	write(addr, buf, 2);
+	return write(addr, buf, 2);
 }
@@ -8,29 +8,64 @@
 
 #pragma once
 
+#include <cstdint>
+
+// Set to 0 to read SDA once per bit instead of majority voting three samples
+#if !defined(SWC_I2C_OVERSAMPLE)
+#define SWC_I2C_OVERSAMPLE 1
+#endif
+
+// How a bus has been doing, kept by its owner across transactions
+struct I2cStats
+{
+    // Start to stop, a repeated start doesn't begin a new one. Probes aren't
+    // counted: a scan expects most addresses to be empty.
+    uint32_t transactions;
+    // Address bytes nobody acknowledged
+    uint32_t addressNacks;
+    // Register and data bytes the device didn't acknowledge
+    uint32_t dataNacks;
+    // Bits read where the samples of SDA didn't all agree
+    uint32_t disagreements;
+};
+
 class BitbangI2c
 {
 public:
-    BitbangI2c(ioline_t scl, ioline_t sda);
+    // stats, if given, is updated by every transaction on the bus
+    BitbangI2c(ioline_t scl, ioline_t sda, I2cStats* stats = nullptr);
     ~BitbangI2c();
 
-    // Write a sequence of bytes to the specified device
-    void write(uint8_t addr, const uint8_t* data, size_t size);
+    // Each returns true if the device acknowledged everything we sent it
+
+    // Write a sequence of bytes to the specified device. Gives up if the
+    // address isn't acknowledged, as does writeRead.
+    bool write(uint8_t addr, const uint8_t* data, size_t size);
     // Read a sequence of bytes from the device
-    void read(uint8_t addr, uint8_t* data, size_t size);
+    bool read(uint8_t addr, uint8_t* data, size_t size);
     // Write some bytes then read some bytes back after a repeated start bit
-    void writeRead(uint8_t addr, const uint8_t* writeData, size_t writeSize, uint8_t* readData, size_t readSize);
+    bool writeRead(uint8_t addr, const uint8_t* writeData, size_t writeSize, uint8_t* readData, size_t readSize);
+
+    // Send just the address byte, returns true if a device acknowledged it.
+    // Not counted in the stats.
+    bool probe(uint8_t addr);
 
     // Read a register at the specified address and register index
     uint8_t readRegister(uint8_t addr, uint8_t reg);
+    // The same, returning false if the device didn't acknowledge
+    bool readRegister(uint8_t addr, uint8_t reg, uint8_t& val);
     // Write a register at the specified address and register index
-    void writeRegister(uint8_t addr, uint8_t reg, uint8_t val);
+    bool writeRegister(uint8_t addr, uint8_t reg, uint8_t val);
 
 private:
     // Returns true if the remote device acknowledged the transmission
     bool writeByte(uint8_t data);
     uint8_t readByte(bool ack);
 
+    // writeByte, counting a NACK in the stats
+    bool writeAddressByte(uint8_t addr, bool read);
+    bool writeDataByte(uint8_t data);
+
     void sda_low();
     void sda_high();
     void scl_low();
@@ -51,4 +86,5 @@ private:
 
     const ioline_t m_scl;
     const ioline_t m_sda;
+    I2cStats* const m_stats;
 };
@@ -0,0 +1,127 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "leds.h"
+
+// Perceptual brightness (0-255) to BCM duty code. Dimming happens in
+// perceptual space, so it needs finer steps than the 16 LED levels.
+static constexpr auto perceptualToCode = makeGammaTable<256>(bcmMaxCode);
+static_assert(perceptualToCode[0] == 0);
+static_assert(perceptualToCode[255] == bcmMaxCode);
+
+static AnimationPlayer player;
+static BcmDriver bcm;
+
+// Host-lit LEDs shine at litLevel, the rest at backgroundLevel.
+// Level 9 is code 18 of 63, about 29% duty, close to the old software PWM's 3/10.
+static constexpr uint8_t backgroundLevel = 0;
+static constexpr uint8_t litLevel = 9;
+
+static uint8_t hostLevels[wingCount][ledsPerWing] = {};
+
+static uint8_t dimming = 255;
+
+static uint8_t levelToCode(uint8_t level)
+{
+    // Levels are 0-15, 17 per step gets us to 0-255
+    uint16_t perceptual = level * 17;
+    return perceptualToCode[perceptual * dimming / 255];
+}
+
+static void setWingLevels(uint8_t (&levels)[ledsPerWing], uint8_t leds, uint8_t lit, uint8_t background)
+{
+    for (size_t i = 0; i < ledsPerWing; i++)
+    {
+        levels[i] = (leds & (1 << i)) ? lit : background;
+    }
+}
+
+static void levelsToCodes(const uint8_t (&levels)[ledsPerWing], uint8_t (&codes)[ledsPerWing])
+{
+    for (size_t i = 0; i < ledsPerWing; i++)
+    {
+        codes[i] = levelToCode(levels[i]);
+    }
+}
+
+void playAnimation(AnimationId id)
+{
+    player.Start(id);
+}
+
+void setHostLeds(const uint8_t* leds)
+{
+    for (size_t wing = 0; wing < wingCount; wing++)
+    {
+        setWingLevels(hostLevels[wing], leds[wing], litLevel, backgroundLevel);
+    }
+
+    // The host knows better than our animation
+    player.Stop();
+}
+
+void setHostLevels(const uint8_t* packed)
+{
+    for (size_t i = 0; i < wingCount * ledsPerWing; i++)
+    {
+        uint8_t level = (packed[i / 2] >> (4 * (i % 2))) & 0xF;
+
+        hostLevels[i / ledsPerWing][i % ledsPerWing] = level;
+    }
+
+    player.Stop();
+}
+
+void setDimming(uint8_t value)
+{
+    dimming = value;
+}
+
+// Animations are written for a left and right wing, the first two.
+// Any others stay dark while one plays.
+static uint8_t animationLeds(const LedFrame& frame, size_t wing)
+{
+    switch (wing)
+    {
+        case 0:
+            return frame.left;
+        case 1:
+            return frame.right;
+        default:
+            return 0;
+    }
+}
+
+void updateLeds(Wings& wings)
+{
+    uint8_t codes[wingCount][ledsPerWing];
+
+    LedFrame frame;
+
+    if (player.Update(frame))
+    {
+        // Animations light only their own LEDs, at the keyframe's level
+        for (size_t wing = 0; wing < wingCount; wing++)
+        {
+            uint8_t levels[ledsPerWing];
+            setWingLevels(levels, animationLeds(frame, wing), frame.level, 0);
+            levelsToCodes(levels, codes[wing]);
+        }
+    }
+    else
+    {
+        for (size_t wing = 0; wing < wingCount; wing++)
+        {
+            levelsToCodes(hostLevels[wing], codes[wing]);
+        }
+    }
+
+    bcm.SetCodes(codes);
+
+    serviceLeds(wings);
+}
+
+void serviceLeds(Wings& wings)
+{
+    bcm.Service(wings);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "animation.h"
+#include "bcm.h"
+
+#include <cstdint>
+
+// Begin playing an animation. It advances from updateLeds, so nothing
+// waits on it: buttons and CAN are live while it plays.
+void playAnimation(AnimationId id);
+
+// Set which LEDs the host wants lit, one byte per wing.
+// This stops any animation that's playing.
+void setHostLeds(const uint8_t* leds);
+
+// Bytes of levels setHostLevels takes
+static constexpr size_t hostLevelsSize = (wingCount * ledsPerWing + 1) / 2;
+static_assert(hostLevelsSize <= 8, "LED levels no longer fit in one CAN frame");
+
+// Set the brightness level (0 to maxLedLevel) of each LED, packed two per byte,
+// low nibble first. LEDs 0-4 are the first wing, 5-9 the second and so on.
+// This stops any animation that's playing.
+void setHostLevels(const uint8_t* packed);
+
+// Scale the brightness of everything, including animations. 255 is full brightness.
+void setDimming(uint8_t dimming);
+
+// Work out what the LEDs should show, once per main loop iteration
+void updateLeds(Wings& wings);
+
+// Brightness is binary code modulated, and the shorter bit planes need to
+// switch more often than once per loop. Call this between wing operations.
+void serviceLeds(Wings& wings);
@@ -0,0 +1,63 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "linkstats.h"
+#include "report.h"
+
+static constexpr size_t statCount = static_cast<size_t>(LinkStat::Count);
+
+// Wing and counter of the next frame, wing-major
+static ReportCursor<wingCount * statCount> report;
+
+uint32_t getLinkStat(const Wing& wing, LinkStat stat)
+{
+    const I2cStats& bus = wing.LinkStats();
+
+    switch (stat)
+    {
+        case LinkStat::Transactions: return bus.transactions;
+        case LinkStat::AddressNacks: return bus.addressNacks;
+        case LinkStat::DataNacks: return bus.dataNacks;
+        case LinkStat::Disagreements: return bus.disagreements;
+        case LinkStat::Dropouts: return wing.Dropouts();
+        case LinkStat::Reinits: return wing.Reinits();
+        case LinkStat::Corrections:
+        {
+            uint32_t total = 0;
+
+            for (size_t chip = 0; chip < wingChipCount; chip++)
+            {
+                total += wing.Corrections(chip);
+            }
+
+            return total;
+        }
+        case LinkStat::Count: break;
+    }
+
+    return 0;
+}
+
+void requestLinkReport()
+{
+    report.Start();
+}
+
+bool serviceLinkReport(const Wings& wings)
+{
+    if (!report.Active())
+    {
+        return false;
+    }
+
+    uint8_t wing = report.Index() / statCount;
+    uint8_t stat = report.Index() % statCount;
+    uint32_t value = getLinkStat(wings[wing], static_cast<LinkStat>(stat));
+
+    // Wing, counter, then the count
+    DiagPayload().U8(wing).U8(stat).U32(value).Send(DiagType::LinkQuality);
+
+    report.Advance();
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "topology.h"
+
+#include <cstdint>
+
+// One counter of how a wing's bus has been doing, all since boot
+enum class LinkStat : uint8_t
+{
+    // I2C transactions
+    Transactions,
+    // Address bytes nobody acknowledged
+    AddressNacks,
+    // Register or data bytes that weren't acknowledged
+    DataNacks,
+    // Bits read where the oversampled SDA levels didn't agree
+    Disagreements,
+    // Times the wing stopped answering
+    Dropouts,
+    // Times the wing was set up again after it came back
+    Reinits,
+    // Expander registers the scrubber found changed and rewrote, all chips
+    Corrections,
+
+    Count,
+};
+
+uint32_t getLinkStat(const Wing& wing, LinkStat stat);
+
+// Queue up every counter for every wing to go out as diagnostic frames, one per loop iteration
+void requestLinkReport();
+
+// Send the next queued counter, if any. Returns true if a frame was sent.
+bool serviceLinkReport(const Wings& wings);
@@ -2,14 +2,40 @@
 #include "hal.h"
 
 #include "wing.h"
+#include "topology.h"
+#include "power.h"
+#include "report.h"
+#include "leds.h"
+#include "profiler.h"
+#include "timestamp.h"
+#include "stacks.h"
+#include "crash.h"
+#include "watchdog.h"
+#include "supply.h"
+#include "telemetry.h"
+#include "linkstats.h"
 
 #include <cstring>
-
-#define LEFT_LED_LINE PAL_LINE(GPIOA, 15)
-#define RIGHT_LED_LINE PAL_LINE(GPIOB, 2)
+#include <iterator>
+#include <utility>
 
 static constexpr uint32_t txCanId = 0x741;
 static constexpr uint32_t rxCanId = 0x742;
+static constexpr uint32_t rxAnimationCanId = 0x744;
+static constexpr uint32_t rxLedLevelsCanId = 0x745;
+static constexpr uint32_t rxDiagRequestCanId = 0x746;
+
+// First byte of a diagnostic request
+enum class DiagRequest : uint8_t
+{
+    // Byte 1 (optional): nonzero resets the stats once they're sent
+    LoopProfile = 1,
+    StackUsage = 2,
+    LinkQuality = 3,
+};
+
+// If nothing at all is heard on the bus for this long, assume the vehicle is off and go to sleep
+static constexpr sysinterval_t canSilenceTimeout = TIME_S2I(30);
 
 // static const CANConfig canConfig100 =
 // {
@@ -36,158 +62,274 @@ static void initCan()
     canStart(&CAND1, &canConfig1000);
 }
 
-static void setLeftStatusLed(bool state)
+static const WingTopology topology[] =
 {
-    if (state)
-    {
-        palSetLine(LEFT_LED_LINE);
-    }
-    else
-    {
-        palClearLine(LEFT_LED_LINE);
-    }
+    // Left
+    { { PAL_LINE(GPIOB, 6), PAL_LINE(GPIOB, 7), { 0, 1, 2 } }, PAL_LINE(GPIOA, 15) },
+    // Right
+    { { PAL_LINE(GPIOB, 10), PAL_LINE(GPIOB, 11), { 0, 1, 2 } }, PAL_LINE(GPIOB, 2) },
+};
+
+static_assert(std::size(topology) == wingCount, "wingCount in topology.h doesn't match the table");
+
+template<size_t... I>
+static Wings makeWings(std::index_sequence<I...>)
+{
+    return { Wing(topology[I].bus)... };
 }
 
-static void setRightStatusLed(bool state)
+static Wings wings = makeWings(std::make_index_sequence<wingCount>());
+
+static void setStatusLed(size_t wing, bool state)
 {
     if (state)
     {
-        palSetLine(RIGHT_LED_LINE);
+        palSetLine(topology[wing].statusLed);
     }
     else
     {
-        palClearLine(RIGHT_LED_LINE);
+        palClearLine(topology[wing].statusLed);
     }
 }
 
 static void initStatusLeds()
 {
-    setLeftStatusLed(false);
-    setRightStatusLed(false);
-
-    palSetLineMode(LEFT_LED_LINE, PAL_MODE_OUTPUT_PUSHPULL);
-    palSetLineMode(RIGHT_LED_LINE, PAL_MODE_OUTPUT_PUSHPULL);
+    for (size_t wing = 0; wing < wingCount; wing++)
+    {
+        setStatusLed(wing, false);
+        palSetLineMode(topology[wing].statusLed, PAL_MODE_OUTPUT_PUSHPULL);
+    }
 }
 
-static Wing left (PAL_LINE(GPIOB, 6), PAL_LINE(GPIOB, 7));
-static Wing right(PAL_LINE(GPIOB, 10), PAL_LINE(GPIOB, 11));
-
 static_assert(STM32_SYSCLK == 48e6);
 
-static const uint16_t startupAnimation[] =
+static const CANFilter canFilters[] =
 {
-    0x0001,
-    0x0002,
-    0x0004,
-    0x0008,
-    0x0010,
-    0x1000,
-    0x0800,
-    0x0400,
-    0x0200,
-    0x0100,
-    0x0200,
-    0x0400,
-    0x0800,
-    0x1000,
-    0x0010,
-    0x0008,
-    0x0004,
-    0x0002,
-    0x0001,
-
-    // Turn all on for a moment
-    0x1F1F,
-    0x1F1F,
-    0x1F1F,
-    0x1F1F,
-    0x1F1F,
+    // Our commands (standard IDs 0x740-0x747) go in FIFO 0
+    {
+        .filter = 0,
+        .mode = 0,
+        .scale = 1,
+        .assignment = 0,
+        .register1 = 0x740u << 21,
+        // Match the top 8 bits of the ID, and IDE must be 0
+        .register2 = (0x7F8u << 21) | 0x4
+    },
+    // Everything else goes in FIFO 1, only used to tell whether the bus is alive
+    {
+        .filter = 1,
+        .mode = 0,
+        .scale = 1,
+        .assignment = 1,
+        .register1 = 0,
+        .register2 = 0
+    },
 };
 
-static uint8_t brightness = 0;
-static uint8_t brightness2 = 3;
-static const uint8_t maxBrightness = 10;
-static uint8_t brightCounter = 0;
+// CAN mailbox 1 is RX FIFO 0, mailbox 2 is RX FIFO 1
+static constexpr canmbx_t commandMailbox = 1;
+static constexpr canmbx_t activityMailbox = 2;
 
-static void driveLeds(uint8_t ledsLeft, uint8_t ledsRight)
+static void sleepUntilCanActivity()
 {
-    brightCounter++;
-    if (brightCounter == maxBrightness) brightCounter = 0;
+    // Outputs off and pins to inputs, then leave the wing buses alone
+    for (size_t wing = 0; wing < wingCount; wing++)
+    {
+        wings[wing].Sleep();
+        setStatusLed(wing, false);
+    }
 
-    uint8_t pressedMask = brightness2 > brightCounter ? 0x1F : 0;
+    suspendSupplyMonitor();
+    prepareWatchdogForSleep();
+    enterStopUntilCanActivity();
+    resumeWatchdog();
+    resumeSupplyMonitor();
+}
 
-    uint8_t l = brightness > brightCounter ? 0x1F : 0;
-    uint8_t r = l;
+// Bench telemetry for a wing, only sent when something changed
+static void sendWingTelemetry(uint8_t index, bool alive, uint8_t expanders, uint16_t inputs)
+{
+    static bool sent[wingCount] = {};
+    static bool lastAlive[wingCount];
+    static uint8_t lastExpanders[wingCount];
+    static uint16_t lastInputs[wingCount];
 
-    l |= (ledsLeft & pressedMask);
-    r |= (ledsRight & pressedMask);
+    if (!sent[index] || alive != lastAlive[index] || expanders != lastExpanders[index])
+    {
+        uint8_t payload[3] = { index, alive, expanders };
+        pushTelemetry(TelemetryType::WingLink, payload, sizeof(payload));
+    }
 
-    left.WriteLeds(l);
-    right.WriteLeds(r);
-}
+    if (!sent[index] || inputs != lastInputs[index])
+    {
+        uint8_t payload[3] = { index, static_cast<uint8_t>(inputs & 0xFF), static_cast<uint8_t>(inputs >> 8) };
+        pushTelemetry(TelemetryType::ExpanderInputs, payload, sizeof(payload));
+    }
 
-static const CANFilter canFilter =
-{
-    .filter = 0,
-    .mode = 1,
-    .scale = 1,
-    .assignment = 0,
-    .register1 = 0xE8400000,
-    .register2 = 0
-};
+    sent[index] = true;
+    lastAlive[index] = alive;
+    lastExpanders[index] = expanders;
+    lastInputs[index] = inputs;
+}
 
 int main(void)
 {
     halInit();
     chSysInit();
 
+    initWatchdog();
     initStatusLeds();
+    initTimestamp();
+    initProfiler();
+    checkCrashRecord();
 
-    canSTM32SetFilters(&CAND1, 1, 1, &canFilter);
+    canSTM32SetFilters(&CAND1, 1, sizeof(canFilters) / sizeof(canFilters[0]), canFilters);
 
     initCan();
 
-    left.Init();
-    right.Init();
-
-    for (size_t i = 0; i < (sizeof(startupAnimation) / sizeof(startupAnimation[0])); i++)
+    if (isWatchdogSleepWake())
     {
-        uint16_t data = startupAnimation[i];
-        uint8_t l = data & 0xFF;
-        uint8_t r = data >> 8;
+        // The watchdog went off while we were asleep, not a hang. The wings
+        // were already put to sleep, so go straight back to waiting for the bus,
+        // marked as asleep again so the next expiry is recognised too.
+        prepareWatchdogForSleep();
+        enterStopUntilCanActivity();
+        resumeWatchdog();
+    }
+
+    // First frame out after boot
+    sendResetCause();
 
-        left.WriteLeds(l);
-        right.WriteLeds(r);
+    initSupplyMonitor();
+    initTelemetry();
 
-        chThdSleepMilliseconds(80);
+    for (auto& wing : wings)
+    {
+        wing.Init();
     }
 
+    playAnimation(AnimationId::Startup);
+
     uint8_t canCounter = 0;
 
-    uint8_t ledsLeft = 0;
-    uint8_t ledsRight = 0;
+    systime_t lastBusActivity = chVTGetSystemTimeX();
+
+    // Set when we wake from STOP, cleared once the first frame after waking has gone out
+    bool measureWake = false;
+    uint32_t wakeTimeUs = 0;
 
     while (true)
     {
-        setLeftStatusLed(left.CheckAliveAndReinit());
-        setRightStatusLed(right.CheckAliveAndReinit());
+        profileLoopStart();
+
+        bool alive[wingCount];
+
+        for (size_t wing = 0; wing < wingCount; wing++)
+        {
+            alive[wing] = wings[wing].CheckAliveAndReinit();
+            setStatusLed(wing, alive[wing]);
+            serviceLeds(wings);
+        }
+        profilePhaseEnd(LoopPhase::Liveness);
 
-        auto buttonsLeft = left.ReadButtons();
-        auto knobLeft = left.ReadKnob();
-        auto buttonsRight = right.ReadButtons();
-        auto knobRight = right.ReadKnob();
+        for (size_t wing = 0; wing < wingCount; wing++)
+        {
+            wings[wing].ReadButtons();
+
+            // The LED update that follows takes care of the last one
+            if (wing + 1 < wingCount)
+            {
+                serviceLeds(wings);
+            }
+        }
+        profilePhaseEnd(LoopPhase::Buttons);
+
+        for (size_t wing = 0; wing < wingCount; wing++)
+        {
+            sendWingTelemetry(wing, alive[wing], wings[wing].ExpandersFound(), wings[wing].RawInputs());
+        }
+
+        for (auto& wing : wings)
+        {
+            wing.ReadKnob();
+        }
+        profilePhaseEnd(LoopPhase::Knob);
+
+        // From here on, anything wanting wing state reads the snapshots
+        for (auto& wing : wings)
+        {
+            wing.PublishState();
+        }
 
         {
             CANRxFrame rxFrame;
-            msg_t res = canReceiveTimeout(&CAND1, 0, &rxFrame, TIME_IMMEDIATE);
-            if (res == MSG_OK && rxFrame.SID == rxCanId)
+            msg_t res = canReceiveTimeout(&CAND1, commandMailbox, &rxFrame, TIME_IMMEDIATE);
+            if (res == MSG_OK)
             {
-                ledsLeft = rxFrame.data8[0];
-                ledsRight = rxFrame.data8[1];
+                lastBusActivity = chVTGetSystemTimeX();
+
+                if (rxFrame.SID == rxCanId)
+                {
+                    // One byte per wing
+                    setHostLeds(&rxFrame.data8[0]);
+                }
+                else if (rxFrame.SID == rxAnimationCanId)
+                {
+                    // Byte 0 picks the animation, 0 stops whatever is playing
+                    playAnimation(static_cast<AnimationId>(rxFrame.data8[0]));
+                }
+                else if (rxFrame.SID == rxLedLevelsCanId && rxFrame.DLC >= hostLevelsSize)
+                {
+                    // Bytes 0-4: a 4 bit level per LED, low nibble first, wings in order
+                    setHostLevels(&rxFrame.data8[0]);
+
+                    // Byte 5 (optional): global dimming, 255 is full brightness
+                    if (rxFrame.DLC > hostLevelsSize)
+                    {
+                        setDimming(rxFrame.data8[hostLevelsSize]);
+                    }
+                }
+                else if (rxFrame.SID == rxDiagRequestCanId && rxFrame.DLC >= 1)
+                {
+                    switch (static_cast<DiagRequest>(rxFrame.data8[0]))
+                    {
+                        case DiagRequest::LoopProfile:
+                            requestProfileReport(rxFrame.DLC >= 2 && rxFrame.data8[1] != 0);
+                            break;
+                        case DiagRequest::StackUsage:
+                            requestStackReport();
+                            break;
+                        case DiagRequest::LinkQuality:
+                            requestLinkReport();
+                            break;
+                    }
+                }
             }
+
+            // We don't care what other traffic is, only that it exists
+            if (canReceiveTimeout(&CAND1, activityMailbox, &rxFrame, TIME_IMMEDIATE) == MSG_OK)
+            {
+                lastBusActivity = chVTGetSystemTimeX();
+            }
+        }
+
+        profilePhaseEnd(LoopPhase::CanRx);
+
+        if (chTimeDiffX(lastBusActivity, chVTGetSystemTimeX()) > canSilenceTimeout)
+        {
+            sleepUntilCanActivity();
+
+            // Clocks are back, resume polling immediately. The wings reinit
+            // themselves on the next CheckAliveAndReinit.
+            wakeTimeUs = getTimestampUs();
+            lastBusActivity = chVTGetSystemTimeX();
+            measureWake = true;
+            canCounter = 0;
+            continue;
         }
 
-        driveLeds(ledsLeft, ledsRight);
+        updateLeds(wings);
+        profilePhaseEnd(LoopPhase::Leds);
 
         if (canCounter == 0)
         {
@@ -198,16 +340,40 @@ int main(void)
             frame.IDE = 0;
             frame.RTR = 0;
 
-            frame.data8[0] = buttonsLeft;
-            frame.data8[1] = buttonsRight;
-            frame.data8[2] = knobLeft;
-            frame.data8[3] = knobRight;
-            frame.DLC = 4;
+            // Every wing's buttons, then every wing's knob
+            for (size_t wing = 0; wing < wingCount; wing++)
+            {
+                WingState state = wings[wing].GetState();
+
+                frame.data8[wing] = state.buttons;
+                frame.data8[wingCount + wing] = state.knob;
+            }
+            frame.DLC = 2 * wingCount;
 
             canTransmitTimeout(&CAND1, 0, &frame, TIME_IMMEDIATE);
+
+            if (measureWake)
+            {
+                measureWake = false;
+
+                // Report how long it took from waking to the first button frame
+                uint32_t wakeUs = getTimestampUs() - wakeTimeUs;
+                DiagPayload().U32(wakeUs).Send(DiagType::WakeLatency);
+            }
         }
 
+        // At most one report frame per iteration, leaving mailboxes free for the button frame
+        if (!serviceCrashReport() && !serviceProfileReport() && !serviceStackReport() && !serviceLinkReport(wings))
+        {
+            serviceSupplyReport();
+        }
+        profilePhaseEnd(LoopPhase::CanTx);
+
         canCounter--;
+        profileLoopEnd();
+
+        // Made it all the way around
+        kickWatchdog();
     }
 }
 
@@ -220,8 +386,6 @@ typedef enum  {
     UsageFault = 6,
 } FaultType;
 
-#define bkpt() __asm volatile("BKPT #0\n")
-
 extern "C" void HardFault_Handler_C(void* sp) {
     //Copy to local variables (not pointers) to allow GDB "i loc" to directly show the info
     //Get thread context. Contains main registers including PC and LR
@@ -230,7 +394,6 @@ extern "C" void HardFault_Handler_C(void* sp) {
 
     //Interrupt status register: Which interrupt have we encountered, e.g. HardFault?
     FaultType faultType = (FaultType)__get_IPSR();
-    (void)faultType;
 #if (__CORTEX_M > 0)
     //For HardFault/BusFault this is the address that was accessed causing the error
     uint32_t faultAddress = SCB->BFAR;
@@ -250,8 +413,9 @@ extern "C" void HardFault_Handler_C(void* sp) {
     (void)isFaultAddressValid;
 #endif
 
-    //Cause debugger to stop. Ignored if no debugger is attached
-    bkpt();
+    //A bkpt here would lock up a Cortex-M0 with no debugger attached, so
+    //save what we know and get the controls back as fast as possible
+    recordCrash(ctx, faultType);
     NVIC_SystemReset();
 }
 
@@ -263,7 +427,6 @@ extern "C" void UsageFault_Handler_C(void* sp) {
 
     //Interrupt status register: Which interrupt have we encountered, e.g. HardFault?
     FaultType faultType = (FaultType)__get_IPSR();
-    (void)faultType;
 #if (__CORTEX_M > 0)
     //Flags about hardfault / busfault
     //See http://infocenter.arm.com/help/index.jsp?topic=/com.arm.doc.dui0552a/Cihdjcfc.html for reference
@@ -281,7 +444,7 @@ extern "C" void UsageFault_Handler_C(void* sp) {
     (void)isDivideByZeroFault;
 #endif
 
-    bkpt();
+    recordCrash(ctx, faultType);
     NVIC_SystemReset();
 }
 
@@ -293,7 +456,6 @@ extern "C" void MemManage_Handler_C(void* sp) {
 
     //Interrupt status register: Which interrupt have we encountered, e.g. HardFault?
     FaultType faultType = (FaultType)__get_IPSR();
-    (void)faultType;
 #if (__CORTEX_M > 0)
     //For HardFault/BusFault this is the address that was accessed causing the error
     uint32_t faultAddress = SCB->MMFAR;
@@ -313,6 +475,6 @@ extern "C" void MemManage_Handler_C(void* sp) {
     (void)isFaultAddressValid;
 #endif
 
-    bkpt();
+    recordCrash(ctx, faultType);
     NVIC_SystemReset();
 }
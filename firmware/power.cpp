@@ -0,0 +1,45 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "power.h"
+
+// CAN RX is on PA11, so it's EXTI line 11
+static constexpr uint32_t canRxExtiLine = 11;
+static constexpr uint32_t canRxExtiMask = 1 << canRxExtiLine;
+
+void enterStopUntilCanActivity()
+{
+    // Put the CAN peripheral in sleep mode so it isn't stopped mid-frame
+    canSleep(&CAND1);
+
+    chSysLock();
+
+    // Route PA11 to EXTI11 (port A is 0), and generate a wakeup event on the falling edge.
+    // The first dominant bit of any frame on the bus wakes us up. This only
+    // needs the event line, not an interrupt, so there's no ISR to install.
+    SYSCFG->EXTICR[canRxExtiLine / 4] &= ~(0xF << ((canRxExtiLine % 4) * 4));
+    EXTI->FTSR |= canRxExtiMask;
+    EXTI->PR = canRxExtiMask;
+    EXTI->EMR |= canRxExtiMask;
+
+    // STOP mode (not standby) with the regulator in low power mode
+    rccEnablePWRInterface(true);
+    PWR->CR = (PWR->CR & ~PWR_CR_PDDS) | PWR_CR_LPDS;
+    SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+
+    // The first WFE consumes any stale event, the second one actually sleeps
+    __SEV();
+    __WFE();
+    __WFE();
+
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+    EXTI->EMR &= ~canRxExtiMask;
+    EXTI->PR = canRxExtiMask;
+
+    // We wake up running from HSI, so get the PLL going again
+    stm32_clock_init();
+
+    chSysUnlock();
+
+    canWakeup(&CAND1);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Enter STOP mode and stay there until the CAN bus shows activity.
+// Returns with the system clock and CAN peripheral running again.
+// The frame that woke us up is lost, since the CAN peripheral has no clock while stopped.
+void enterStopUntilCanActivity();
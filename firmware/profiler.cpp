@@ -0,0 +1,132 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "profiler.h"
+#include "report.h"
+#include "timestamp.h"
+#include "telemetry.h"
+
+#if SWC_PROFILER
+
+struct PhaseStats
+{
+    uint16_t min;
+    uint16_t max;
+    uint32_t total;
+    uint32_t count;
+};
+
+static PhaseStats stats[static_cast<size_t>(LoopPhase::Count)];
+
+// This iteration's times, for telemetry
+static uint16_t lastElapsed[static_cast<size_t>(LoopPhase::Count)];
+
+static uint32_t loopStart;
+static uint32_t phaseStart;
+
+static ReportCursor<static_cast<size_t>(LoopPhase::Count)> report;
+static bool resetAfterReport = false;
+
+static inline uint32_t now()
+{
+    return getTimestampUs();
+}
+
+static void resetStats()
+{
+    for (auto& s : stats)
+    {
+        s.min = UINT16_MAX;
+        s.max = 0;
+        s.total = 0;
+        s.count = 0;
+    }
+}
+
+static void record(LoopPhase phase, uint32_t elapsedUs)
+{
+    // Anything over 65ms is pinned at the max
+    uint16_t elapsed = elapsedUs > UINT16_MAX ? UINT16_MAX : elapsedUs;
+    lastElapsed[static_cast<size_t>(phase)] = elapsed;
+
+    PhaseStats& s = stats[static_cast<size_t>(phase)];
+
+    if (elapsed < s.min)
+    {
+        s.min = elapsed;
+    }
+
+    if (elapsed > s.max)
+    {
+        s.max = elapsed;
+    }
+
+    // Halve both before the count saturates, so the total can't overflow
+    // (at most 65535 samples of 65535us) and the average keeps following
+    // the loop, weighted towards recent iterations
+    if (s.count == UINT16_MAX)
+    {
+        s.total /= 2;
+        s.count /= 2;
+    }
+
+    s.total += elapsed;
+    s.count++;
+}
+
+void initProfiler()
+{
+    resetStats();
+}
+
+void profileLoopStart()
+{
+    loopStart = now();
+    phaseStart = loopStart;
+}
+
+void profilePhaseEnd(LoopPhase phase)
+{
+    uint32_t t = now();
+
+    // Unsigned subtraction handles the counter wrapping
+    record(phase, t - phaseStart);
+
+    phaseStart = t;
+}
+
+void profileLoopEnd()
+{
+    record(LoopPhase::Loop, now() - loopStart);
+
+    pushTelemetry(TelemetryType::LoopTiming, reinterpret_cast<const uint8_t*>(lastElapsed), sizeof(lastElapsed));
+}
+
+void requestProfileReport(bool resetAfter)
+{
+    report.Start();
+    resetAfterReport = resetAfter;
+}
+
+bool serviceProfileReport()
+{
+    if (!report.Active())
+    {
+        return false;
+    }
+
+    const PhaseStats& s = stats[report.Index()];
+    uint16_t avg = s.count ? s.total / s.count : 0;
+
+    // Phase, then min, max, avg in microseconds
+    DiagPayload().U8(report.Index()).U16(s.min).U16(s.max).U16(avg).Send(DiagType::LoopProfile);
+
+    if (report.Advance() && resetAfterReport)
+    {
+        resetStats();
+    }
+
+    return true;
+}
+
+#endif // SWC_PROFILER
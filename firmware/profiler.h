@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+// Set to 0 to build without loop profiling
+#if !defined(SWC_PROFILER)
+#define SWC_PROFILER 1
+#endif
+
+enum class LoopPhase : uint8_t
+{
+    Liveness,
+    Buttons,
+    Knob,
+    CanRx,
+    Leds,
+    CanTx,
+
+    // The whole iteration, start to end
+    Loop,
+
+    Count,
+};
+
+#if SWC_PROFILER
+
+// Clear the stats, the timestamp service must already be running
+void initProfiler();
+
+// Mark the start of a loop iteration
+void profileLoopStart();
+
+// The phase that just finished, ie, everything since the previous mark
+void profilePhaseEnd(LoopPhase phase);
+
+// Mark the end of a loop iteration
+void profileLoopEnd();
+
+// Queue up the stats to go out as diagnostic frames, one phase per loop iteration
+void requestProfileReport(bool resetAfter);
+
+// Send the next queued stats frame, if any. Returns true if a frame was sent.
+bool serviceProfileReport();
+
+#else
+
+static inline void initProfiler() { }
+static inline void profileLoopStart() { }
+static inline void profilePhaseEnd(LoopPhase) { }
+static inline void profileLoopEnd() { }
+static inline void requestProfileReport(bool) { }
+static inline bool serviceProfileReport() { return false; }
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "diag.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Little-endian fields packed into a diagnostic frame's payload, in order.
+// Anything past the 7 bytes a frame holds is dropped.
+class DiagPayload
+{
+public:
+    DiagPayload& U8(uint8_t value)
+    {
+        if (m_size < sizeof(m_data))
+        {
+            m_data[m_size++] = value;
+        }
+
+        return *this;
+    }
+
+    DiagPayload& U16(uint16_t value)
+    {
+        return U8(value & 0xFF).U8(value >> 8);
+    }
+
+    DiagPayload& U32(uint32_t value)
+    {
+        return U16(value & 0xFFFF).U16(value >> 16);
+    }
+
+    void Send(DiagType type) const
+    {
+        sendDiagnostic(type, m_data, m_size);
+    }
+
+private:
+    uint8_t m_data[7];
+    size_t m_size = 0;
+};
+
+// Where a report that goes out as Count diagnostic frames is up to. Requesting
+// it starts it over, then the service call sends one frame per loop iteration.
+template<size_t Count>
+class ReportCursor
+{
+    static constexpr uint8_t idle = 0xFF;
+
+    static_assert(Count > 0 && Count < idle, "report has too many frames for the cursor");
+
+public:
+    // Start from the first frame, even if a report is already going out
+    void Start()
+    {
+        m_next = 0;
+    }
+
+    bool Active() const
+    {
+        return m_next != idle;
+    }
+
+    // The frame to send now, only valid while Active
+    uint8_t Index() const
+    {
+        return m_next;
+    }
+
+    // Move on once a frame is sent. Returns true if that was the last one.
+    bool Advance()
+    {
+        m_next++;
+
+        if (m_next == Count)
+        {
+            m_next = idle;
+            return true;
+        }
+
+        return false;
+    }
+
+private:
+    uint8_t m_next = idle;
+};
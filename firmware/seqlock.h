@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Publishes a value from one writer to any number of readers, in any
+// context, without locking. Readers always get a value that was written
+// whole, never half of one write and half of the next.
+//
+// There are two copies, and the sequence number's low bit says which one
+// readers should use. The writer only ever writes the copy readers have been
+// pointed away from. So a reader interrupting the writer (an ISR, say) gets
+// the previous value straight away instead of spinning on a write that can't
+// finish until it returns. A reader only retries if the writer interrupts it
+// and finishes a whole write while it was copying.
+template<typename T>
+class Seqlock
+{
+public:
+    // Only one context may write
+    void Write(const T& value)
+    {
+        uint32_t seq = m_seq.load(std::memory_order_relaxed);
+
+        // Readers over to copy 1 while copy 0 is written
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_copies[0] = value;
+
+        // And back again for copy 1
+        m_seq.store(seq + 2, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_copies[1] = value;
+    }
+
+    // Returns how many times it had to retry, normally 0
+    uint32_t Read(T& value) const
+    {
+        uint32_t retries = 0;
+
+        while (true)
+        {
+            uint32_t seq = m_seq.load(std::memory_order_acquire);
+            value = m_copies[seq & 1];
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (m_seq.load(std::memory_order_relaxed) == seq)
+            {
+                return retries;
+            }
+
+            retries++;
+        }
+    }
+
+    T Read() const
+    {
+        T value;
+        Read(value);
+        return value;
+    }
+
+private:
+    std::atomic<uint32_t> m_seq = 0;
+    T m_copies[2] = {};
+};
@@ -0,0 +1,124 @@
+/**
+ * @file        bench.cpp
+ * @brief       Bus cost of each Wing operation and of the whole main loop
+ *
+ * usage: swc_bench [loop iterations] [quarter bit ns]
+ *
+ * Runs against simulated wings and prints JSON on stdout, so results can be
+ * diffed or tracked between changes to wing.cpp and i2c_bb.cpp.
+ */
+
+#include "sim.h"
+#include "sim_wing.h"
+#include "bus_monitor.h"
+
+#include "wing.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+static const ioline_t leftScl = PAL_LINE(GPIOB, 6);
+static const ioline_t leftSda = PAL_LINE(GPIOB, 7);
+static const ioline_t rightScl = PAL_LINE(GPIOB, 10);
+static const ioline_t rightSda = PAL_LINE(GPIOB, 11);
+
+static void printCounts(const char* name, const BusMonitor::Counts& c, uint64_t ns, uint64_t n, bool last)
+{
+    printf("    \"%s\": { \"calls\": %llu, \"scl_edges\": %.1f, \"transactions\": %.2f, \"bytes\": %.2f, \"bus_busy_us\": %.2f, \"time_us\": %.2f }%s\n",
+        name,
+        (unsigned long long)n,
+        (double)c.sclEdges / n,
+        // A transaction is everything from a start to its stop, repeated starts included
+        (double)c.stops / n,
+        (double)c.bytes / n,
+        c.busyNs / 1000.0 / n,
+        ns / 1000.0 / n,
+        last ? "" : ",");
+}
+
+// Time one Wing operation, averaged over some calls
+static void benchMethod(const char* name, BusMonitor& monitor, const std::function<void()>& op, bool last = false)
+{
+    constexpr uint64_t calls = 100;
+
+    monitor.Reset();
+    uint64_t start = sim::nowNs();
+
+    for (uint64_t i = 0; i < calls; i++)
+    {
+        op();
+    }
+
+    printCounts(name, monitor.GetCounts(), sim::nowNs() - start, calls, last);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1000;
+
+    if (argc > 2)
+    {
+        sim::setQuarterBitNs(strtoul(argv[2], nullptr, 0));
+    }
+
+    SimWing simLeft(leftScl, leftSda);
+    SimWing simRight(rightScl, rightSda);
+    simLeft.SetButtons(0);
+    simRight.SetButtons(0);
+
+    BusMonitor leftMonitor(leftScl, leftSda);
+    BusMonitor rightMonitor(rightScl, rightSda);
+
+    printf("{\n");
+    printf("  \"quarter_bit_ns\": %u,\n", sim::quarterBitNs());
+    printf("  \"wing\": {\n");
+
+    {
+        // A separate Wing on the left bus, so none of the firmware's state is touched
+        Wing wing({ leftScl, leftSda });
+        uint8_t leds = 0;
+
+        benchMethod("Init", leftMonitor, [&]() { wing.Init(); });
+        benchMethod("Scrub", leftMonitor, [&]() { wing.Scrub(); });
+        benchMethod("CheckAliveAndReinit", leftMonitor, [&]() { wing.CheckAliveAndReinit(); });
+        benchMethod("ReadButtons", leftMonitor, [&]() { wing.ReadButtons(); });
+        benchMethod("ReadKnob", leftMonitor, [&]() { wing.ReadKnob(); });
+        benchMethod("WriteLeds_changed", leftMonitor, [&]() { wing.WriteLeds(leds++); });
+        benchMethod("WriteLeds_unchanged", leftMonitor, [&]() { wing.WriteLeds(0); }, true);
+    }
+
+    printf("  },\n");
+
+    // Whole main loop, after the startup animation is over, with the host
+    // asking for a mix of brightness levels so the LED modulation is busy
+    constexpr uint32_t warmup = 10;
+    uint8_t levels[] = { 0x3F, 0x9C, 0x0F, 0x5A, 0xE1, 0xC0 };
+    sim::scheduleRx(0, 0x745, levels, sizeof(levels));
+
+    uint64_t loopStart = 0;
+    sim::RunLimits limits;
+    limits.untilNs = UINT64_MAX;
+    limits.maxIterations = warmup + iterations;
+    limits.onIteration = [&](uint32_t i)
+    {
+        if (i == warmup)
+        {
+            leftMonitor.Reset();
+            rightMonitor.Reset();
+            loopStart = sim::nowNs();
+        }
+    };
+
+    sim::runFirmware(limits);
+
+    uint64_t loopNs = sim::nowNs() - loopStart;
+
+    printf("  \"loop\": {\n");
+    printCounts("left", leftMonitor.GetCounts(), loopNs, iterations, false);
+    printCounts("right", rightMonitor.GetCounts(), loopNs, iterations, true);
+    printf("  }\n");
+    printf("}\n");
+
+    return 0;
+}
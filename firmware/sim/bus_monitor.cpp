@@ -0,0 +1,73 @@
+/**
+ * @file        bus_monitor.cpp
+ * @brief       Passive I2C bus monitor for the host simulator
+ */
+
+#include "bus_monitor.h"
+
+BusMonitor::BusMonitor(ioline_t scl, ioline_t sda)
+    : m_scl(scl)
+    , m_sda(sda)
+{
+    sim::attachDevice(this, scl);
+    sim::attachDevice(this, sda);
+
+    m_sclLevel = sim::lineLevel(scl);
+}
+
+BusMonitor::~BusMonitor()
+{
+    sim::detachDevice(this);
+}
+
+void BusMonitor::endFrame()
+{
+    m_counts.bytes += m_clocksSinceStart / 9;
+    m_clocksSinceStart = 0;
+}
+
+void BusMonitor::onLineChange(ioline_t line, bool level)
+{
+    if (line == m_scl)
+    {
+        m_sclLevel = level;
+        m_counts.sclEdges++;
+
+        if (level)
+        {
+            m_clocksSinceStart++;
+        }
+
+        return;
+    }
+
+    if (line != m_sda || !m_sclLevel)
+    {
+        return;
+    }
+
+    if (!level)
+    {
+        // Start, or repeated start
+        endFrame();
+        m_counts.starts++;
+
+        if (!m_busy)
+        {
+            m_busy = true;
+            m_busySince = sim::nowNs();
+        }
+    }
+    else
+    {
+        // Stop
+        endFrame();
+        m_counts.stops++;
+
+        if (m_busy)
+        {
+            m_busy = false;
+            m_counts.busyNs += sim::nowNs() - m_busySince;
+        }
+    }
+}
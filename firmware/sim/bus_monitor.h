@@ -0,0 +1,64 @@
+/**
+ * @file        bus_monitor.h
+ * @brief       Passive I2C bus monitor for the host simulator
+ *
+ * Sits on a simulated bus like a logic analyzer and counts what goes by.
+ */
+
+#pragma once
+
+#include "sim.h"
+
+#include <cstdint>
+
+class BusMonitor : public sim::BusDevice
+{
+public:
+    BusMonitor(ioline_t scl, ioline_t sda);
+    ~BusMonitor();
+
+    struct Counts
+    {
+        // Every transition of SCL, both directions
+        uint64_t sclEdges;
+        // Start conditions, including repeated starts
+        uint64_t starts;
+        uint64_t stops;
+        // Complete 9 clock frames (8 data bits + ACK)
+        uint64_t bytes;
+        // Virtual time spent between a start and its stop
+        uint64_t busyNs;
+    };
+
+    const Counts& GetCounts() const
+    {
+        return m_counts;
+    }
+
+    void Reset()
+    {
+        m_counts = {};
+    }
+
+    // sim::BusDevice
+    void onLineChange(ioline_t line, bool level) override;
+
+    bool pullsDown(ioline_t) const override
+    {
+        return false;
+    }
+
+private:
+    // Counts up the bytes clocked since the last start
+    void endFrame();
+
+    const ioline_t m_scl;
+    const ioline_t m_sda;
+
+    bool m_sclLevel;
+    bool m_busy = false;
+    uint64_t m_busySince = 0;
+    uint32_t m_clocksSinceStart = 0;
+
+    Counts m_counts = {};
+};
@@ -0,0 +1,295 @@
+/**
+ * @file        pca9557_model.cpp
+ * @brief       Bit-level model of a PCA9557 on a simulated I2C bus
+ */
+
+#include "pca9557_model.h"
+
+Pca9557Model::Pca9557Model(ioline_t scl, ioline_t sda, uint8_t offset)
+    : m_scl(scl)
+    , m_sda(sda)
+    , m_address(baseAddress + offset)
+{
+    PowerOnReset();
+
+    sim::attachDevice(this, scl);
+    sim::attachDevice(this, sda);
+
+    m_sclLevel = sim::lineLevel(scl);
+    m_sdaLevel = sim::lineLevel(sda);
+}
+
+Pca9557Model::~Pca9557Model()
+{
+    sim::detachDevice(this);
+}
+
+void Pca9557Model::PowerOnReset()
+{
+    // PCA9557 - 8.6
+    m_regs[Input] = 0;
+    m_regs[Output] = 0x00;
+    m_regs[PolarityInversion] = 0xF0;
+    m_regs[Configuration] = 0xFF;
+
+    m_state = State::Idle;
+    m_driveLow = false;
+    m_pointer = 0;
+}
+
+void Pca9557Model::SetPinInputs(uint8_t levels)
+{
+    m_pinInputs = levels;
+}
+
+uint8_t Pca9557Model::PinOutputs() const
+{
+    // Configuration: 1 is input, 0 is output
+    return m_regs[Output] | m_regs[Configuration];
+}
+
+uint8_t Pca9557Model::ReadRegister(uint8_t reg) const
+{
+    if (reg == Input)
+    {
+        uint8_t config = m_regs[Configuration];
+        uint8_t pins = (m_pinInputs & config) | (m_regs[Output] & ~config);
+
+        return pins ^ m_regs[PolarityInversion];
+    }
+
+    return m_regs[reg];
+}
+
+void Pca9557Model::SetDisconnected(bool disconnected)
+{
+    m_disconnected = disconnected;
+
+    if (disconnected)
+    {
+        m_state = State::Idle;
+        m_driveLow = false;
+    }
+    else
+    {
+        // We weren't watching while disconnected
+        m_sclLevel = sim::lineLevel(m_scl);
+        m_sdaLevel = sim::lineLevel(m_sda);
+    }
+}
+
+void Pca9557Model::SetStuckSda(bool stuck)
+{
+    m_stuckSda = stuck;
+}
+
+void Pca9557Model::FlipNextBits(uint32_t n)
+{
+    m_flipNext = n;
+}
+
+void Pca9557Model::SetBitFlipRate(double rate, uint32_t seed)
+{
+    m_flipRate = rate;
+    m_rng.seed(seed);
+}
+
+bool Pca9557Model::pullsDown(ioline_t line) const
+{
+    if (line != m_sda)
+    {
+        return false;
+    }
+
+    return m_stuckSda || (!m_disconnected && m_driveLow);
+}
+
+void Pca9557Model::onLineChange(ioline_t line, bool level)
+{
+    if (m_disconnected)
+    {
+        return;
+    }
+
+    if (line == m_scl)
+    {
+        m_sclLevel = level;
+
+        if (level)
+        {
+            onSclRise();
+        }
+        else
+        {
+            onSclFall();
+        }
+    }
+    else if (line == m_sda)
+    {
+        m_sdaLevel = level;
+
+        // SDA only changes while SCL is high for start and stop conditions
+        if (!m_sclLevel)
+        {
+            return;
+        }
+
+        if (!level)
+        {
+            // Start (or repeated start)
+            m_state = State::Receive;
+            m_shift = 0;
+            m_bitCount = 0;
+            m_byteIndex = 0;
+            m_driveLow = false;
+        }
+        else
+        {
+            // Stop
+            m_state = State::Idle;
+            m_driveLow = false;
+        }
+    }
+}
+
+void Pca9557Model::onSclRise()
+{
+    switch (m_state)
+    {
+        case State::Receive:
+            m_shift = (m_shift << 1) | (m_sdaLevel ? 1 : 0);
+            m_bitCount++;
+            break;
+        case State::MasterAck:
+            // Low is ACK, the master wants another byte
+            m_masterAcked = !m_sdaLevel;
+            break;
+        default:
+            break;
+    }
+}
+
+void Pca9557Model::onSclFall()
+{
+    switch (m_state)
+    {
+        case State::Receive:
+            if (m_bitCount == 8)
+            {
+                onByteReceived();
+            }
+            break;
+        case State::Ack:
+            // Done with the ACK clock, let go of SDA
+            m_driveLow = false;
+
+            if (m_read)
+            {
+                startTransmit();
+            }
+            else
+            {
+                m_state = State::Receive;
+                m_shift = 0;
+                m_bitCount = 0;
+            }
+            break;
+        case State::Transmit:
+            m_bitCount++;
+
+            if (m_bitCount < 8)
+            {
+                driveBit((m_shift << m_bitCount) & 0x80);
+            }
+            else
+            {
+                // Release SDA so the master can ACK
+                m_driveLow = false;
+                m_state = State::MasterAck;
+            }
+            break;
+        case State::MasterAck:
+            if (m_masterAcked)
+            {
+                // The register pointer doesn't auto-increment, keep sending the same register
+                startTransmit();
+            }
+            else
+            {
+                m_state = State::Idle;
+            }
+            break;
+        case State::Idle:
+            break;
+    }
+}
+
+void Pca9557Model::onByteReceived()
+{
+    uint8_t data = m_shift;
+
+    if (m_byteIndex == 0)
+    {
+        if ((data >> 1) != m_address)
+        {
+            // Not for us, sit out until the next start
+            m_state = State::Idle;
+            return;
+        }
+
+        m_read = data & 1;
+        m_stats.transactions++;
+    }
+    else if (m_byteIndex == 1)
+    {
+        // Command byte: only the low two bits select a register
+        m_pointer = data & 0x03;
+    }
+    else
+    {
+        // Writes to the input register are ignored
+        if (m_pointer != Input)
+        {
+            m_regs[m_pointer] = data;
+        }
+
+        m_stats.registerWrites[m_pointer]++;
+
+        if (m_writeObserver)
+        {
+            m_writeObserver(static_cast<Register>(m_pointer), data);
+        }
+    }
+
+    m_byteIndex++;
+
+    m_state = State::Ack;
+    m_driveLow = true;
+}
+
+void Pca9557Model::startTransmit()
+{
+    m_shift = ReadRegister(m_pointer);
+    m_stats.registerReads[m_pointer]++;
+
+    m_bitCount = 0;
+    m_state = State::Transmit;
+    driveBit(m_shift & 0x80);
+}
+
+void Pca9557Model::driveBit(bool bit)
+{
+    if (m_flipNext > 0)
+    {
+        m_flipNext--;
+        bit = !bit;
+        m_stats.bitsFlipped++;
+    }
+    else if (m_flipRate > 0 && std::uniform_real_distribution<double>(0, 1)(m_rng) < m_flipRate)
+    {
+        bit = !bit;
+        m_stats.bitsFlipped++;
+    }
+
+    m_driveLow = !bit;
+}
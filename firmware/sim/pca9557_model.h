@@ -0,0 +1,153 @@
+/**
+ * @file        pca9557_model.h
+ * @brief       Bit-level model of a PCA9557 on a simulated I2C bus
+ *
+ * Watches SCL/SDA edges like the real chip: start/stop detection, address
+ * match, ACK/NACK, and the four registers of Pca9557::Opcode. Faults can be
+ * injected to see how the firmware copes.
+ */
+
+#pragma once
+
+#include "sim.h"
+
+#include <cstdint>
+#include <functional>
+#include <random>
+
+class Pca9557Model : public sim::BusDevice
+{
+public:
+    // PCA9557 - 8.3.2.1
+    static constexpr uint8_t baseAddress = 0x18;
+
+    enum Register : uint8_t
+    {
+        Input = 0,
+        Output = 1,
+        PolarityInversion = 2,
+        Configuration = 3,
+    };
+
+    Pca9557Model(ioline_t scl, ioline_t sda, uint8_t offset);
+    ~Pca9557Model();
+
+    // Back to power-on register values
+    void PowerOnReset();
+
+    // Levels of the pins as seen from outside when they aren't driven by the chip
+    void SetPinInputs(uint8_t levels);
+
+    // Levels of the pins the chip is driving, 1 for pins configured as inputs
+    uint8_t PinOutputs() const;
+
+    uint8_t GetRegister(Register reg) const
+    {
+        return m_regs[reg];
+    }
+
+    // Called whenever the master writes a register
+    void SetWriteObserver(std::function<void(Register, uint8_t)> observer)
+    {
+        m_writeObserver = std::move(observer);
+    }
+
+    // Change a register behind the firmware's back, like a glitch would
+    void CorruptRegister(Register reg, uint8_t value)
+    {
+        m_regs[reg] = value;
+    }
+
+    /*
+     * Fault injection
+     */
+
+    // Stop responding entirely, like a broken wire through the slip ring
+    void SetDisconnected(bool disconnected);
+    // Hold SDA low no matter what
+    void SetStuckSda(bool stuck);
+    // Flip the next n bits the chip sends
+    void FlipNextBits(uint32_t n);
+    // Flip each bit the chip sends with this probability
+    void SetBitFlipRate(double rate, uint32_t seed = 1);
+
+    /*
+     * Statistics
+     */
+
+    struct Stats
+    {
+        // Transactions addressed to this chip
+        uint32_t transactions;
+        uint32_t registerWrites[4];
+        uint32_t registerReads[4];
+        uint32_t bitsFlipped;
+    };
+
+    const Stats& GetStats() const
+    {
+        return m_stats;
+    }
+
+    void ResetStats()
+    {
+        m_stats = {};
+    }
+
+    // sim::BusDevice
+    void onLineChange(ioline_t line, bool level) override;
+    bool pullsDown(ioline_t line) const override;
+
+private:
+    enum class State
+    {
+        // Waiting for a start condition
+        Idle,
+        // Shifting in a byte from the master
+        Receive,
+        // Holding SDA low for the ACK clock
+        Ack,
+        // Shifting out a byte to the master
+        Transmit,
+        // Waiting to see if the master ACKs what we sent
+        MasterAck,
+    };
+
+    void onSclRise();
+    void onSclFall();
+    void onByteReceived();
+    void startTransmit();
+    void driveBit(bool bit);
+
+    uint8_t ReadRegister(uint8_t reg) const;
+
+    const ioline_t m_scl;
+    const ioline_t m_sda;
+    const uint8_t m_address;
+
+    bool m_sclLevel = true;
+    bool m_sdaLevel = true;
+
+    State m_state = State::Idle;
+    uint8_t m_shift = 0;
+    uint8_t m_bitCount = 0;
+    uint8_t m_byteIndex = 0;
+    bool m_read = false;
+    bool m_masterAcked = false;
+    uint8_t m_pointer = 0;
+
+    bool m_driveLow = false;
+
+    uint8_t m_regs[4];
+    uint8_t m_pinInputs = 0xFF;
+
+    bool m_disconnected = false;
+    bool m_stuckSda = false;
+    uint32_t m_flipNext = 0;
+    double m_flipRate = 0;
+    std::mt19937 m_rng;
+
+    Stats m_stats = {};
+
+    std::function<void(Register, uint8_t)> m_writeObserver;
+};
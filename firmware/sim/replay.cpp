@@ -0,0 +1,332 @@
+/**
+ * @file        replay.cpp
+ * @brief       Replay a recorded CAN log into the simulated firmware
+ *
+ * usage: swc_replay <log> [--offset ms] [--out file]
+ *
+ * Feeds the frames in a candump log (-L format, or the -ta console format)
+ * into the simulated CAN bus with their original spacing, starting --offset
+ * ms after boot. The real firmware loop runs against two simulated wings.
+ *
+ * Reports how long on/off LED commands take to reach the expanders, how many
+ * frames were lost to full RX FIFOs, and the rate of what the firmware
+ * sends. --out writes everything it sent as a candump -L log.
+ */
+
+#include "sim.h"
+#include "sim_wing.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+struct LoggedFrame
+{
+    uint64_t timeNs;
+    uint32_t sid;
+    uint8_t dlc;
+    uint8_t data[8];
+};
+
+static uint8_t parseHexBytes(const char* s, uint8_t* data)
+{
+    uint8_t n = 0;
+
+    while (n < 8)
+    {
+        while (*s == ' ')
+        {
+            s++;
+        }
+
+        unsigned int byte;
+        if (sscanf(s, "%2x", &byte) != 1)
+        {
+            break;
+        }
+
+        data[n++] = byte;
+        s += 2;
+    }
+
+    return n;
+}
+
+// Accepts "(1600000000.123456) can0 742#0102" and "(1600000000.123456)  can0  742   [2]  01 02"
+static bool parseLine(const char* line, double& time, LoggedFrame& frame)
+{
+    char iface[32];
+    unsigned int id;
+    // %n isn't counted in the return, so it's only been set if this is still >= 0
+    int consumed = -1;
+
+    if (sscanf(line, " (%lf) %31s %x#%n", &time, iface, &id, &consumed) == 3 && consumed >= 0)
+    {
+        // Remote frames and CAN FD don't interest us
+        if (line[consumed] == 'R' || line[consumed] == '#')
+        {
+            return false;
+        }
+
+        frame.sid = id;
+        frame.dlc = parseHexBytes(line + consumed, frame.data);
+        return true;
+    }
+
+    unsigned int dlc;
+    consumed = -1;
+
+    if (sscanf(line, " (%lf) %31s %x [%u] %n", &time, iface, &id, &dlc, &consumed) == 4 && consumed >= 0)
+    {
+        frame.sid = id;
+        frame.dlc = std::min(parseHexBytes(line + consumed, frame.data), static_cast<uint8_t>(dlc));
+        return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <log> [--offset ms] [--out file]\n", argv[0]);
+        return 2;
+    }
+
+    uint64_t offsetNs = 0;
+    const char* outPath = nullptr;
+
+    for (int i = 2; i + 1 < argc; i++)
+    {
+        if (!strcmp(argv[i], "--offset"))
+        {
+            offsetNs = strtoull(argv[++i], nullptr, 0) * 1'000'000;
+        }
+        else if (!strcmp(argv[i], "--out"))
+        {
+            outPath = argv[++i];
+        }
+    }
+
+    FILE* in = fopen(argv[1], "r");
+    if (!in)
+    {
+        fprintf(stderr, "can't open %s\n", argv[1]);
+        return 2;
+    }
+
+    std::vector<LoggedFrame> frames;
+    double firstTime = -1;
+    char line[256];
+
+    while (fgets(line, sizeof(line), in))
+    {
+        double time;
+        LoggedFrame frame = {};
+
+        if (!parseLine(line, time, frame))
+        {
+            continue;
+        }
+
+        if (firstTime < 0)
+        {
+            firstTime = time;
+        }
+
+        frame.timeNs = offsetNs + static_cast<uint64_t>((time - firstTime) * 1e9);
+        frames.push_back(frame);
+    }
+
+    fclose(in);
+
+    if (frames.empty())
+    {
+        fprintf(stderr, "no frames in %s\n", argv[1]);
+        return 2;
+    }
+
+    SimWing left(PAL_LINE(GPIOB, 6), PAL_LINE(GPIOB, 7));
+    SimWing right(PAL_LINE(GPIOB, 10), PAL_LINE(GPIOB, 11));
+    left.SetButtons(0);
+    right.SetButtons(0);
+
+    // The on/off LED command (0x742) is the one we can check exactly: with
+    // BCM, some bit plane shows precisely the LEDs it asked for. Latency is
+    // from the frame hitting the bus to both wings' outputs showing it.
+    struct PendingCommand
+    {
+        uint64_t arrival;
+        uint8_t left;
+        uint8_t right;
+    };
+
+    std::deque<PendingCommand> pending;
+    std::vector<uint64_t> latencies;
+    uint32_t superseded = 0;
+    uint32_t alreadyShowing = 0;
+    size_t nextCommand = 0;
+
+    for (const auto& f : frames)
+    {
+        sim::scheduleRx(f.timeNs, f.sid, f.data, f.dlc);
+    }
+
+    auto admitCommands = [&]()
+    {
+        uint64_t now = sim::nowNs();
+
+        while (nextCommand < frames.size() && frames[nextCommand].timeNs <= now)
+        {
+            const auto& f = frames[nextCommand++];
+
+            if (f.sid != 0x742 || f.dlc < 2)
+            {
+                continue;
+            }
+
+            uint8_t l = f.data[0] & 0x1F;
+            uint8_t r = f.data[1] & 0x1F;
+
+            // A newer command replaces one that never made it out
+            superseded += pending.size();
+            pending.clear();
+
+            if (left.GetLeds() == l && right.GetLeds() == r)
+            {
+                alreadyShowing++;
+                continue;
+            }
+
+            pending.push_back({ f.timeNs, l, r });
+        }
+    };
+
+    auto onWrite = [&](Pca9557Model::Register reg, uint8_t)
+    {
+        if (reg != Pca9557Model::Output)
+        {
+            return;
+        }
+
+        admitCommands();
+
+        if (!pending.empty() && left.GetLeds() == pending.front().left && right.GetLeds() == pending.front().right)
+        {
+            latencies.push_back(sim::nowNs() - pending.front().arrival);
+            pending.clear();
+        }
+    };
+
+    for (size_t wing = 0; wing < 2; wing++)
+    {
+        SimWing& w = wing ? right : left;
+
+        for (size_t chip = 0; chip < SimWing::chipCount; chip++)
+        {
+            w.Chip(chip).SetWriteObserver(onWrite);
+        }
+    }
+
+    sim::RunLimits limits;
+    limits.untilNs = frames.back().timeNs + 100'000'000;
+    limits.onIteration = [&](uint32_t) { admitCommands(); };
+
+    sim::runFirmware(limits);
+
+    uint32_t neverShown = pending.size();
+
+    uint64_t durationNs = sim::nowNs();
+
+    printf("replayed %zu frames over %.3f s, %u lost to full RX FIFOs\n", frames.size(), durationNs / 1e9, sim::rxOverruns());
+    printf("main loop: %u iterations, %.1f us average\n", sim::loopIterations(), durationNs / 1e3 / std::max<uint32_t>(1, sim::loopIterations()));
+
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+
+        uint64_t sum = 0;
+        for (auto l : latencies)
+        {
+            sum += l;
+        }
+
+        printf("LED command (0x742) to expander outputs: %zu commands, min %.1f us, avg %.1f us, p99 %.1f us, max %.1f us\n",
+            latencies.size(),
+            latencies.front() / 1e3,
+            sum / 1e3 / latencies.size(),
+            latencies[latencies.size() * 99 / 100] / 1e3,
+            latencies.back() / 1e3);
+    }
+
+    printf("LED commands already showing: %u, replaced before shown: %u, never shown: %u\n", alreadyShowing, superseded, neverShown);
+
+    // TX rate per ID
+    const auto& tx = sim::txFrames();
+    std::vector<uint32_t> ids;
+    for (const auto& t : tx)
+    {
+        if (std::find(ids.begin(), ids.end(), t.frame.SID) == ids.end())
+        {
+            ids.push_back(t.frame.SID);
+        }
+    }
+
+    std::sort(ids.begin(), ids.end());
+
+    for (uint32_t id : ids)
+    {
+        uint32_t count = 0;
+        uint64_t last = 0;
+        uint64_t maxGap = 0;
+
+        for (const auto& t : tx)
+        {
+            if (t.frame.SID != id)
+            {
+                continue;
+            }
+
+            if (count)
+            {
+                maxGap = std::max(maxGap, t.timeNs - last);
+            }
+
+            last = t.timeNs;
+            count++;
+        }
+
+        printf("TX %03X: %u frames, %.1f Hz, max gap %.1f ms\n", id, count, count / (durationNs / 1e9), maxGap / 1e6);
+    }
+
+    if (outPath)
+    {
+        FILE* out = fopen(outPath, "w");
+        if (!out)
+        {
+            fprintf(stderr, "can't write %s\n", outPath);
+            return 2;
+        }
+
+        for (const auto& t : tx)
+        {
+            fprintf(out, "(%" PRIu64 ".%06" PRIu64 ") sim %03X#", t.timeNs / 1'000'000'000, t.timeNs / 1000 % 1'000'000, (unsigned)t.frame.SID);
+
+            for (size_t i = 0; i < t.frame.DLC; i++)
+            {
+                fprintf(out, "%02X", t.frame.data8[i]);
+            }
+
+            fprintf(out, "\n");
+        }
+
+        fclose(out);
+    }
+
+    return 0;
+}
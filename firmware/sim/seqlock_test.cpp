@@ -0,0 +1,137 @@
+/**
+ * @file        seqlock_test.cpp
+ * @brief       Deterministic interleavings of Seqlock reads and writes
+ *
+ * usage: swc_seqlock_test
+ *
+ * Stands in for an interrupt by running a nested Write or Read half way
+ * through copying a WingState, between its fields, so each interleaving
+ * happens exactly where it's wanted instead of whenever threads line up.
+ * Checks what comes back is one whole write and that Read reports the right
+ * number of retries.
+ *
+ * Exits nonzero if any case fails.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "seqlock.h"
+#include "wing.h"
+
+#include <cstdio>
+#include <functional>
+
+// Every field of write n is derived from n, so a copy made of two writes
+// can't pass for one
+static WingState stateFor(uint32_t n)
+{
+    return { static_cast<uint8_t>(n), static_cast<uint8_t>(n * 7), (n & 1) != 0, n * 1000 };
+}
+
+static bool isWhole(const WingState& s, uint32_t& n)
+{
+    n = s.timestampUs / 1000;
+
+    WingState expected = stateFor(n);
+    return s.timestampUs % 1000 == 0
+        && s.buttons == expected.buttons
+        && s.knob == expected.knob
+        && s.alive == expected.alive;
+}
+
+// Runs once half way through a copy, after skipping some copies
+static std::function<void()> interrupt;
+static int copiesToSkip = 0;
+static int interruptsLeft = 0;
+static bool interrupting = false;
+
+struct InterruptibleState
+{
+    WingState state;
+
+    InterruptibleState& operator=(const InterruptibleState& other)
+    {
+        state.buttons = other.state.buttons;
+        state.knob = other.state.knob;
+
+        if (!interrupting && interruptsLeft > 0 && copiesToSkip-- <= 0)
+        {
+            interruptsLeft--;
+            interrupting = true;
+            interrupt();
+            interrupting = false;
+        }
+
+        state.alive = other.state.alive;
+        state.timestampUs = other.state.timestampUs;
+        return *this;
+    }
+};
+
+static Seqlock<InterruptibleState> lock;
+static uint32_t written = 0;
+static int failures = 0;
+
+static void publish()
+{
+    written++;
+    lock.Write({ stateFor(written) });
+}
+
+static void check(const char* name, bool ok)
+{
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+static void interruptWith(std::function<void()> f, int skip, int count)
+{
+    interrupt = f;
+    copiesToSkip = skip;
+    interruptsLeft = count;
+}
+
+int main()
+{
+    uint32_t n;
+    InterruptibleState got;
+
+    // Nothing in the way
+    publish();
+    uint32_t retries = lock.Read(got);
+    check("read alone", retries == 0 && isWhole(got.state, n) && n == written);
+
+    // A reader interrupting the writer while it's on copy 0 is pointed at
+    // copy 1, which still holds the previous write
+    publish();
+    uint32_t previous = written;
+    InterruptibleState midWrite;
+    uint32_t midRetries = ~0u;
+    interruptWith([&]() { midRetries = lock.Read(midWrite); }, 0, 1);
+    publish();
+    check("read during first copy of write", midRetries == 0 && isWhole(midWrite.state, n) && n == previous);
+
+    // On copy 1 the new value is already whole in copy 0
+    interruptWith([&]() { midRetries = lock.Read(midWrite); }, 1, 1);
+    publish();
+    check("read during second copy of write", midRetries == 0 && isWhole(midWrite.state, n) && n == written);
+
+    // A whole write landing while the reader copies makes it go round again,
+    // once per write, and it comes back with the last one
+    for (int writes = 1; writes <= 3; writes++)
+    {
+        interruptWith(publish, 0, writes);
+        retries = lock.Read(got);
+
+        char name[64];
+        snprintf(name, sizeof(name), "%d write(s) during read", writes);
+        check(name, retries == static_cast<uint32_t>(writes) && isWhole(got.state, n) && n == written);
+    }
+
+    // And it's all settled afterwards
+    retries = lock.Read(got);
+    check("read after", retries == 0 && isWhole(got.state, n) && n == written);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file        ch.h
+ * @brief       Host stand-in for the parts of ChibiOS/RT the firmware uses
+ *
+ * Time is virtual: it only moves when the simulated hardware says so.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+// Use the real config so tick rates match the firmware
+#include "chconf.h"
+
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+typedef uint64_t time_conv_t;
+typedef int32_t msg_t;
+
+#define MSG_OK ((msg_t)0)
+#define MSG_TIMEOUT ((msg_t)-1)
+#define MSG_RESET ((msg_t)-2)
+
+#define TIME_IMMEDIATE ((sysinterval_t)0)
+#define TIME_INFINITE ((sysinterval_t)-1)
+
+// Same rounding as ChibiOS: conversions to ticks and from ticks both round up
+#define TIME_S2I(secs) ((sysinterval_t)((time_conv_t)(secs) * (time_conv_t)CH_CFG_ST_FREQUENCY))
+#define TIME_MS2I(msecs) ((sysinterval_t)((((time_conv_t)(msecs) * (time_conv_t)CH_CFG_ST_FREQUENCY) + 999) / 1000))
+#define TIME_US2I(usecs) ((sysinterval_t)((((time_conv_t)(usecs) * (time_conv_t)CH_CFG_ST_FREQUENCY) + 999999) / 1000000))
+#define TIME_I2MS(interval) ((time_conv_t)((((time_conv_t)(interval) * 1000) + (time_conv_t)CH_CFG_ST_FREQUENCY - 1) / (time_conv_t)CH_CFG_ST_FREQUENCY))
+#define TIME_I2US(interval) ((time_conv_t)((((time_conv_t)(interval) * 1000000) + (time_conv_t)CH_CFG_ST_FREQUENCY - 1) / (time_conv_t)CH_CFG_ST_FREQUENCY))
+
+systime_t chVTGetSystemTimeX();
+
+inline systime_t chVTGetSystemTime()
+{
+    return chVTGetSystemTimeX();
+}
+
+inline sysinterval_t chTimeDiffX(systime_t start, systime_t end)
+{
+    return end - start;
+}
+
+void chSysInit();
+
+// Single threaded, so these only need to exist
+inline void chSysLock() { }
+inline void chSysUnlock() { }
+inline void chSysLockFromISR() { }
+inline void chSysUnlockFromISR() { }
+
+typedef uint32_t syssts_t;
+inline syssts_t chSysGetStatusAndLockX() { return 0; }
+inline void chSysRestoreStatusX(syssts_t) { }
+
+void chThdSleep(sysinterval_t time);
+
+inline void chThdSleepMilliseconds(uint32_t msec)
+{
+    chThdSleep(TIME_MS2I(msec));
+}
+
+inline void chThdSleepMicroseconds(uint32_t usec)
+{
+    chThdSleep(TIME_US2I(usec));
+}
+
+#define chDbgAssert(c, r) do { (void)(c); } while (0)
+#define osalDbgAssert(c, r) chDbgAssert(c, r)
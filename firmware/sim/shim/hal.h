@@ -0,0 +1,436 @@
+/**
+ * @file        hal.h
+ * @brief       Host stand-in for the parts of the ChibiOS HAL and STM32F0 CMSIS the firmware uses
+ *
+ * Peripherals are backed by the simulated state in sim_hal.cpp. Registers
+ * that the firmware pokes directly are plain structs, so writes land
+ * somewhere the simulation can look at them.
+ */
+
+#pragma once
+
+#include "ch.h"
+
+#include "halconf.h"
+
+/*===========================================================================*/
+/* PAL                                                                       */
+/*===========================================================================*/
+
+typedef uint32_t ioline_t;
+typedef uint32_t iomode_t;
+
+// Ports are pointers to their register blocks, as in stm32f0xx.h, so that
+// PAL_LINE isn't a constant expression here either. A line is the port's
+// address with the pad in the low bits, as in ChibiOS.
+struct stm32_gpio_t;
+typedef stm32_gpio_t* ioportid_t;
+
+#define GPIOA_BASE 0x48000000U
+#define GPIOB_BASE 0x48000400U
+#define GPIOC_BASE 0x48000800U
+#define GPIOF_BASE 0x48001400U
+
+#define GPIOA ((stm32_gpio_t*)GPIOA_BASE)
+#define GPIOB ((stm32_gpio_t*)GPIOB_BASE)
+#define GPIOC ((stm32_gpio_t*)GPIOC_BASE)
+#define GPIOF ((stm32_gpio_t*)GPIOF_BASE)
+
+#define PAL_LINE(port, pad) ((ioline_t)((uint32_t)(uintptr_t)(port) | (uint32_t)(pad)))
+#define PAL_PORT(line) ((stm32_gpio_t*)(uintptr_t)((line) & 0xFFFFFFF0U))
+#define PAL_PAD(line) ((uint32_t)(line) & 0x0FU)
+
+#define PAL_MODE_RESET 0
+#define PAL_MODE_UNCONNECTED 1
+#define PAL_MODE_INPUT 2
+#define PAL_MODE_INPUT_PULLUP 3
+#define PAL_MODE_INPUT_PULLDOWN 4
+#define PAL_MODE_INPUT_ANALOG 5
+#define PAL_MODE_OUTPUT_PUSHPULL 6
+#define PAL_MODE_OUTPUT_OPENDRAIN 7
+#define PAL_MODE_ALTERNATE(n) (0x100 | (n))
+
+#define PAL_LOW 0
+#define PAL_HIGH 1
+
+void palSetLine(ioline_t line);
+void palClearLine(ioline_t line);
+int palReadLine(ioline_t line);
+void palSetLineMode(ioline_t line, iomode_t mode);
+
+inline void palWriteLine(ioline_t line, int bit)
+{
+    if (bit)
+    {
+        palSetLine(line);
+    }
+    else
+    {
+        palClearLine(line);
+    }
+}
+
+inline void palSetPadMode(ioportid_t port, uint32_t pad, iomode_t mode)
+{
+    palSetLineMode(PAL_LINE(port, pad), mode);
+}
+
+/*===========================================================================*/
+/* CAN                                                                       */
+/*===========================================================================*/
+
+typedef uint32_t canmbx_t;
+#define CAN_ANY_MAILBOX 0U
+
+#define CAN_MCR_TXFP (1U << 2)
+#define CAN_MCR_AWUM (1U << 5)
+#define CAN_MCR_ABOM (1U << 6)
+
+#define CAN_BTR_BRP(n) ((uint32_t)(n))
+#define CAN_BTR_TS1(n) ((uint32_t)(n) << 16)
+#define CAN_BTR_TS2(n) ((uint32_t)(n) << 20)
+#define CAN_BTR_SJW(n) ((uint32_t)(n) << 24)
+
+struct CANConfig
+{
+    uint32_t mcr;
+    uint32_t btr;
+};
+
+struct CANFilter
+{
+    uint32_t filter:5;
+    uint32_t mode:1;
+    uint32_t scale:1;
+    uint32_t assignment:1;
+    uint32_t register1;
+    uint32_t register2;
+};
+
+struct CANTxFrame
+{
+    uint8_t DLC:4;
+    uint8_t RTR:1;
+    uint8_t IDE:1;
+    union
+    {
+        uint32_t SID:11;
+        uint32_t EID:29;
+    };
+    union
+    {
+        uint8_t data8[8];
+        uint16_t data16[4];
+        uint32_t data32[2];
+    };
+};
+
+struct CANRxFrame
+{
+    uint8_t FMI;
+    uint16_t TIME;
+    uint8_t DLC:4;
+    uint8_t RTR:1;
+    uint8_t IDE:1;
+    union
+    {
+        uint32_t SID:11;
+        uint32_t EID:29;
+    };
+    union
+    {
+        uint8_t data8[8];
+        uint16_t data16[4];
+        uint32_t data32[2];
+    };
+};
+
+struct CANDriver
+{
+    bool started;
+    bool asleep;
+};
+
+extern CANDriver CAND1;
+
+void canStart(CANDriver* canp, const CANConfig* config);
+void canStop(CANDriver* canp);
+void canSTM32SetFilters(CANDriver* canp, uint32_t can2sb, uint32_t num, const CANFilter* cfp);
+msg_t canReceiveTimeout(CANDriver* canp, canmbx_t mailbox, CANRxFrame* crfp, sysinterval_t timeout);
+msg_t canTransmitTimeout(CANDriver* canp, canmbx_t mailbox, const CANTxFrame* ctfp, sysinterval_t timeout);
+void canSleep(CANDriver* canp);
+void canWakeup(CANDriver* canp);
+
+/*===========================================================================*/
+/* ADC                                                                       */
+/*===========================================================================*/
+
+typedef uint16_t adcsample_t;
+typedef uint16_t adc_channels_num_t;
+
+enum adcstate_t
+{
+    ADC_UNINIT,
+    ADC_STOP,
+    ADC_READY,
+    ADC_ACTIVE,
+    ADC_COMPLETE,
+    ADC_ERROR,
+};
+
+struct ADCDriver;
+typedef void (*adccallback_t)(ADCDriver* adcp);
+typedef void (*adcerrorcallback_t)(ADCDriver* adcp, uint32_t err);
+
+struct ADCConversionGroup
+{
+    bool circular;
+    adc_channels_num_t num_channels;
+    adccallback_t end_cb;
+    adcerrorcallback_t error_cb;
+    uint32_t cfgr1;
+    uint32_t tr;
+    uint32_t smpr;
+    uint32_t chselr;
+};
+
+struct ADCConfig
+{
+    uint32_t dummy;
+};
+
+struct ADCDriver
+{
+    adcstate_t state;
+    const ADCConversionGroup* grpp;
+    adcsample_t* samples;
+    size_t depth;
+};
+
+extern ADCDriver ADCD1;
+
+#define adcIsBufferComplete(adcp) ((bool)((adcp)->state == ADC_COMPLETE))
+
+// Conversions complete as simulated time passes, see sim_hal.cpp
+void adcStart(ADCDriver* adcp, const ADCConfig* config);
+void adcStartConversion(ADCDriver* adcp, const ADCConversionGroup* grpp, adcsample_t* samples, size_t depth);
+void adcStopConversion(ADCDriver* adcp);
+void adcSTM32SetCCR(uint32_t ccr);
+
+#define ADC_CFGR1_RES_12BIT (0U << 3)
+#define ADC_CFGR1_CONT (1U << 13)
+#define ADC_TR(low, high) (((uint32_t)(high) << 16) | (uint32_t)(low))
+#define ADC_SMPR_SMP_239P5 7U
+#define ADC_CHSELR_CHSEL8 (1U << 8)
+#define ADC_CHSELR_CHSEL16 (1U << 16)
+#define ADC_CHSELR_CHSEL17 (1U << 17)
+#define ADC_CCR_VREFEN (1U << 22)
+#define ADC_CCR_TSEN (1U << 23)
+
+// Factory calibration in system memory, with typical values
+extern const uint16_t simVrefintCal;
+extern const uint16_t simTsCal1;
+extern const uint16_t simTsCal2;
+
+#define VREFINT_CAL simVrefintCal
+#define TS_CAL1 simTsCal1
+#define TS_CAL2 simTsCal2
+
+/*===========================================================================*/
+/* UART                                                                      */
+/*===========================================================================*/
+
+struct UARTDriver;
+typedef void (*uartcb_t)(UARTDriver* uartp);
+typedef void (*uartccb_t)(UARTDriver* uartp, uint16_t c);
+typedef void (*uartecb_t)(UARTDriver* uartp, uint32_t e);
+
+struct UARTConfig
+{
+    uartcb_t txend1_cb;
+    uartcb_t txend2_cb;
+    uartcb_t rxend_cb;
+    uartccb_t rxchar_cb;
+    uartecb_t rxerr_cb;
+    uartcb_t timeout_cb;
+    uint32_t timeout;
+    uint32_t speed;
+    uint32_t cr1;
+    uint32_t cr2;
+    uint32_t cr3;
+};
+
+struct UARTDriver
+{
+    const UARTConfig* config;
+    const uint8_t* txbuf;
+    size_t txsize;
+    bool txactive;
+};
+
+extern UARTDriver UARTD1;
+
+// Sends complete at the configured baud rate as simulated time passes, see sim_hal.cpp
+void uartStart(UARTDriver* uartp, const UARTConfig* config);
+void uartStartSendI(UARTDriver* uartp, size_t n, const void* txbuf);
+
+/*===========================================================================*/
+/* WDG                                                                       */
+/*===========================================================================*/
+
+struct WDGConfig
+{
+    uint32_t pr;
+    uint32_t rlr;
+    uint32_t winr;
+};
+
+struct WDGDriver
+{
+    const WDGConfig* config;
+};
+
+extern WDGDriver WDGD1;
+
+#define STM32_IWDG_PR_4 0U
+#define STM32_IWDG_PR_8 1U
+#define STM32_IWDG_PR_16 2U
+#define STM32_IWDG_PR_32 3U
+#define STM32_IWDG_PR_64 4U
+#define STM32_IWDG_PR_128 5U
+#define STM32_IWDG_PR_256 6U
+#define STM32_IWDG_RL(n) ((n) << 0)
+#define STM32_IWDG_WIN_DISABLED 0x0FFFU
+
+// Expiring resets the firmware, see sim_hal.cpp
+void wdgStart(WDGDriver* wdgp, const WDGConfig* config);
+void wdgReset(WDGDriver* wdgp);
+
+/*===========================================================================*/
+/* System, clocks and registers touched directly                             */
+/*===========================================================================*/
+
+#define STM32_SYSCLK 48000000U
+#define STM32_TIMCLK1 48000000U
+
+void halInit();
+void stm32_clock_init();
+
+#define rccEnablePWRInterface(lp) ((void)(lp))
+#define rccEnableTIM3(lp) ((void)(lp))
+
+struct SYSCFG_TypeDef
+{
+    uint32_t CFGR1;
+    uint32_t RESERVED;
+    uint32_t EXTICR[4];
+    uint32_t CFGR2;
+};
+
+struct EXTI_TypeDef
+{
+    uint32_t IMR;
+    uint32_t EMR;
+    uint32_t RTSR;
+    uint32_t FTSR;
+    uint32_t SWIER;
+    uint32_t PR;
+};
+
+struct RCC_TypeDef
+{
+    uint32_t CSR;
+};
+
+struct PWR_TypeDef
+{
+    uint32_t CR;
+    uint32_t CSR;
+};
+
+struct SCB_Type
+{
+    uint32_t CPUID;
+    uint32_t ICSR;
+    uint32_t RESERVED0;
+    uint32_t AIRCR;
+    uint32_t SCR;
+    uint32_t CCR;
+};
+
+// Reading CNT derives the count from simulated time and the prescaler
+struct SimTimerCount
+{
+    operator uint32_t() const;
+};
+
+struct TIM_TypeDef
+{
+    uint32_t CR1;
+    uint32_t DIER;
+    uint32_t SR;
+    uint32_t EGR;
+    uint32_t PSC;
+    uint32_t ARR;
+    SimTimerCount CNT;
+};
+
+extern SYSCFG_TypeDef simSYSCFG;
+extern EXTI_TypeDef simEXTI;
+extern RCC_TypeDef simRCC;
+extern PWR_TypeDef simPWR;
+extern SCB_Type simSCB;
+extern TIM_TypeDef simTIM3;
+
+#define SYSCFG (&simSYSCFG)
+#define EXTI (&simEXTI)
+#define RCC (&simRCC)
+#define PWR (&simPWR)
+#define SCB (&simSCB)
+#define TIM3 (&simTIM3)
+
+#define RCC_CSR_RMVF (1U << 24)
+#define RCC_CSR_OBLRSTF (1U << 25)
+#define RCC_CSR_PINRSTF (1U << 26)
+#define RCC_CSR_PORRSTF (1U << 27)
+#define RCC_CSR_SFTRSTF (1U << 28)
+#define RCC_CSR_IWDGRSTF (1U << 29)
+#define RCC_CSR_WWDGRSTF (1U << 30)
+#define RCC_CSR_LPWRRSTF (1U << 31)
+#define PWR_CR_LPDS (1U << 0)
+#define PWR_CR_PDDS (1U << 1)
+#define SCB_SCR_SLEEPDEEP_Msk (1U << 2)
+#define TIM_CR1_CEN (1U << 0)
+#define TIM_EGR_UG (1U << 0)
+#define TIM_DIER_UIE (1U << 0)
+#define TIM_SR_UIF (1U << 0)
+
+// Interrupts are called from the simulator when their time comes, see sim_hal.cpp
+#define STM32_TIM3_HANDLER Vector80
+#define STM32_TIM3_NUMBER 16
+#define CH_IRQ_HANDLER(id) extern "C" void id(void)
+#define CH_IRQ_PROLOGUE()
+#define CH_IRQ_EPILOGUE()
+#define nvicEnableVector(n, prio) ((void)(n), (void)(prio))
+
+extern "C" void STM32_TIM3_HANDLER(void);
+
+#define __CORTEX_M 0
+
+// Stacked exception frame
+struct port_extctx
+{
+    uint32_t r0;
+    uint32_t r1;
+    uint32_t r2;
+    uint32_t r3;
+    uint32_t r12;
+    uint32_t lr_thd;
+    uint32_t pc;
+    uint32_t xpsr;
+};
+
+void __SEV();
+void __WFE();
+uint32_t __get_IPSR();
+[[noreturn]] void NVIC_SystemReset();
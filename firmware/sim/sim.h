@@ -0,0 +1,149 @@
+/**
+ * @file        sim.h
+ * @brief       Simulated hardware for the host build
+ *
+ * The firmware runs on the calling thread against simulated GPIO, CAN and
+ * time. It hands control back when a stop condition is hit: the shim throws
+ * SimStop from a safe point, which unwinds out of the firmware's main().
+ */
+
+#pragma once
+
+#include "hal.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace sim
+{
+
+enum class RunEnd
+{
+    // Hit a limit
+    Limit,
+    // Went to sleep with no more CAN traffic coming to wake us up
+    Asleep,
+    // Firmware called NVIC_SystemReset
+    Reset,
+};
+
+// Thrown out of the firmware when the run is over
+struct SimStop
+{
+    RunEnd reason;
+};
+
+/*
+ * Time
+ */
+
+// Virtual time since boot
+uint64_t nowNs();
+void advanceNs(uint64_t ns);
+
+// How long BitbangI2c::waitQuarterBit takes. On the F042 at 48MHz it's about 1us.
+void setQuarterBitNs(uint32_t ns);
+uint32_t quarterBitNs();
+
+// Called by BitbangI2c::waitQuarterBit
+void waitQuarterBit();
+
+/*
+ * GPIO
+ */
+
+// The level a line actually sits at: pulled up unless something drives it low
+bool lineLevel(ioline_t line);
+iomode_t lineMode(ioline_t line);
+
+// Drive a line from outside the MCU. Open drain: true pulls it low.
+void setExternalPullDown(ioline_t line, bool pullDown);
+
+// Something outside the MCU hanging off some lines, like an I2C device
+class BusDevice
+{
+public:
+    virtual ~BusDevice() = default;
+
+    // A line this device is attached to changed level
+    virtual void onLineChange(ioline_t line, bool level) = 0;
+
+    // Whether this device is currently pulling a line low
+    virtual bool pullsDown(ioline_t line) const = 0;
+};
+
+// Attach a device to a line. It gets told about every level change on the
+// line, and its pull downs count towards the line's level. Devices changing
+// their pulls from onLineChange is fine, changes settle before control
+// returns to the firmware.
+void attachDevice(BusDevice* device, ioline_t line);
+void detachDevice(BusDevice* device);
+
+/*
+ * CAN
+ */
+
+struct TxRecord
+{
+    uint64_t timeNs;
+    CANTxFrame frame;
+};
+
+// Queue a frame to arrive on the bus at some time. Goes through the
+// configured filters on arrival, and is lost if we're in STOP.
+void scheduleRx(uint64_t timeNs, uint32_t sid, const uint8_t* data, uint8_t dlc);
+
+const std::vector<TxRecord>& txFrames();
+
+// Frames dropped because their FIFO was full
+uint32_t rxOverruns();
+
+/*
+ * UART
+ */
+
+// Every byte the firmware has sent out USART1
+const std::vector<uint8_t>& uartTx();
+
+/*
+ * Analog
+ */
+
+// What the ADC sees on VDDA and the temperature sensor. 3300mV and 25C by default.
+void setSupplyMv(uint32_t mv);
+void setMcuTemperature(int32_t celsius);
+// The vehicle supply ahead of VBAT_SENSE's 11:1 divider, 13800mV by default
+void setVehicleMv(uint32_t mv);
+
+/*
+ * Power
+ */
+
+uint32_t stopEntries();
+
+/*
+ * Running
+ */
+
+struct RunLimits
+{
+    // Stop at the first loop iteration boundary at or after this time
+    uint64_t untilNs = 1'000'000'000;
+    // Stop after this many main loop iterations, 0 for no limit
+    uint32_t maxIterations = 0;
+
+    // Called at the start of each main loop iteration, with the number of
+    // iterations completed so far
+    std::function<void(uint32_t)> onIteration;
+};
+
+// Boot the firmware and run it until a limit is hit. The firmware's
+// statics persist across calls, so use one process per boot.
+RunEnd runFirmware(const RunLimits& limits);
+
+// Main loop iterations so far. The loop polls the CAN command FIFO exactly
+// once per iteration, so that's what gets counted.
+uint32_t loopIterations();
+
+} // namespace sim
@@ -0,0 +1,833 @@
+/**
+ * @file        sim_hal.cpp
+ * @brief       Simulated state behind the ChibiOS shim
+ */
+
+#include "sim.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+// The firmware's main(), renamed when built for the host
+int firmwareMain();
+
+namespace sim
+{
+
+static uint64_t timeNs = 0;
+static uint32_t quarterBit = 1000;
+
+static uint32_t iterations = 0;
+static RunLimits limits;
+
+static void serviceTimers();
+static void serviceWatchdog();
+static uint64_t watchdogExpiryNs();
+static void serviceAdc();
+static void serviceUart();
+
+uint64_t nowNs()
+{
+    return timeNs;
+}
+
+void advanceNs(uint64_t ns)
+{
+    timeNs += ns;
+    serviceTimers();
+    serviceAdc();
+    serviceUart();
+    serviceWatchdog();
+}
+
+void setQuarterBitNs(uint32_t ns)
+{
+    quarterBit = ns;
+}
+
+uint32_t quarterBitNs()
+{
+    return quarterBit;
+}
+
+void waitQuarterBit()
+{
+    advanceNs(quarterBit);
+}
+
+/*
+ * GPIO
+ */
+
+static constexpr size_t lineCount = 6 * 16;
+
+struct LineState
+{
+    iomode_t mode = PAL_MODE_INPUT;
+    bool latch = false;
+    bool externalPullDown = false;
+
+    // Level devices were last told about
+    bool lastLevel = true;
+    std::vector<BusDevice*> devices;
+};
+
+static LineState lines[lineCount];
+
+// Port registers are 0x400 apart from GPIOA
+static LineState& lineState(ioline_t line)
+{
+    size_t port = ((uintptr_t)PAL_PORT(line) - GPIOA_BASE) / 0x400;
+    return lines[port * 16 + PAL_PAD(line)];
+}
+
+// Lines with at least one device attached
+static std::vector<ioline_t> watchedLines;
+
+bool lineLevel(ioline_t line)
+{
+    const LineState& l = lineState(line);
+
+    if (l.mode == PAL_MODE_OUTPUT_PUSHPULL)
+    {
+        return l.latch;
+    }
+
+    bool mcuPullsDown = l.mode == PAL_MODE_OUTPUT_OPENDRAIN && !l.latch;
+
+    bool devicePullsDown = false;
+    for (auto dev : l.devices)
+    {
+        devicePullsDown |= dev->pullsDown(line);
+    }
+
+    // Everything else idles high, like the I2C pullups
+    return !(mcuPullsDown || l.externalPullDown || devicePullsDown);
+}
+
+// Tell devices about any line that changed level, until nothing changes.
+// A device reacting to an edge (say, ACKing) can cause another edge.
+static void propagateLines()
+{
+    bool changed = true;
+
+    for (size_t pass = 0; changed && pass < 16; pass++)
+    {
+        changed = false;
+
+        for (ioline_t line : watchedLines)
+        {
+            LineState& l = lineState(line);
+
+            bool level = lineLevel(line);
+            if (level == l.lastLevel)
+            {
+                continue;
+            }
+
+            l.lastLevel = level;
+            changed = true;
+
+            for (auto dev : l.devices)
+            {
+                dev->onLineChange(line, level);
+            }
+        }
+    }
+}
+
+void attachDevice(BusDevice* device, ioline_t line)
+{
+    if (lineState(line).devices.empty())
+    {
+        watchedLines.push_back(line);
+    }
+
+    lineState(line).devices.push_back(device);
+    lineState(line).lastLevel = lineLevel(line);
+}
+
+void detachDevice(BusDevice* device)
+{
+    for (auto& l : lines)
+    {
+        l.devices.erase(std::remove(l.devices.begin(), l.devices.end(), device), l.devices.end());
+    }
+}
+
+iomode_t lineMode(ioline_t line)
+{
+    return lineState(line).mode;
+}
+
+void setExternalPullDown(ioline_t line, bool pullDown)
+{
+    lineState(line).externalPullDown = pullDown;
+    propagateLines();
+}
+
+/*
+ * CAN
+ */
+
+struct ScheduledFrame
+{
+    uint64_t timeNs;
+    CANRxFrame frame;
+};
+
+static std::deque<ScheduledFrame> scheduled;
+static std::deque<CANRxFrame> fifos[2];
+static std::vector<CANFilter> filters;
+static std::vector<TxRecord> transmitted;
+static uint32_t overruns = 0;
+
+// bxCAN FIFOs are 3 deep
+static constexpr size_t fifoDepth = 3;
+
+void scheduleRx(uint64_t timeNs, uint32_t sid, const uint8_t* data, uint8_t dlc)
+{
+    ScheduledFrame s = {};
+    s.timeNs = timeNs;
+    s.frame.SID = sid;
+    s.frame.DLC = dlc;
+    memcpy(s.frame.data8, data, std::min<size_t>(dlc, 8));
+
+    auto it = std::upper_bound(scheduled.begin(), scheduled.end(), timeNs,
+        [](uint64_t t, const ScheduledFrame& f) { return t < f.timeNs; });
+    scheduled.insert(it, s);
+}
+
+const std::vector<TxRecord>& txFrames()
+{
+    return transmitted;
+}
+
+uint32_t rxOverruns()
+{
+    return overruns;
+}
+
+static bool filterMatches(const CANFilter& f, const CANRxFrame& frame)
+{
+    // Only 32 bit scale is modeled: STID in bits 31:21, IDE bit 2, RTR bit 1
+    uint32_t word = (frame.SID << 21) | (frame.IDE << 2) | (frame.RTR << 1);
+
+    if (f.mode)
+    {
+        // Identifier list
+        return word == f.register1 || word == f.register2;
+    }
+
+    // Identifier mask
+    return (word & f.register2) == (f.register1 & f.register2);
+}
+
+// Returns the FIFO a frame lands in, or -1 if no filter accepts it
+static int matchFilters(const CANRxFrame& frame)
+{
+    // List mode beats mask mode, then the lower filter number wins
+    for (int listMode = 1; listMode >= 0; listMode--)
+    {
+        const CANFilter* best = nullptr;
+
+        for (const auto& f : filters)
+        {
+            if (f.mode == listMode && filterMatches(f, frame) && (!best || f.filter < best->filter))
+            {
+                best = &f;
+            }
+        }
+
+        if (best)
+        {
+            return best->assignment;
+        }
+    }
+
+    return -1;
+}
+
+// Move any frames that have arrived by now into the RX FIFOs
+static void deliverFrames()
+{
+    while (!scheduled.empty() && scheduled.front().timeNs <= timeNs)
+    {
+        CANRxFrame frame = scheduled.front().frame;
+        scheduled.pop_front();
+
+        if (!CAND1.started || CAND1.asleep)
+        {
+            continue;
+        }
+
+        int fifo = matchFilters(frame);
+        if (fifo < 0)
+        {
+            continue;
+        }
+
+        if (fifos[fifo].size() >= fifoDepth)
+        {
+            overruns++;
+            continue;
+        }
+
+        fifos[fifo].push_back(frame);
+    }
+}
+
+/*
+ * Power
+ */
+
+static uint32_t stops = 0;
+static bool eventRegister = false;
+
+uint32_t stopEntries()
+{
+    return stops;
+}
+
+static void sleepUntilEvent()
+{
+    bool deep = simSCB.SCR & SCB_SCR_SLEEPDEEP_Msk;
+
+    // CAN RX (PA11) is the only wakeup source we model
+    constexpr uint32_t canRxMask = 1 << 11;
+    bool canWakes = (simEXTI.EMR & canRxMask) && (simEXTI.FTSR & canRxMask);
+
+    if (!deep || !canWakes || scheduled.empty())
+    {
+        // Nothing will ever wake us
+        throw SimStop{ RunEnd::Asleep };
+    }
+
+    stops++;
+
+    // The watchdog keeps running, so it may reset us first. Then the frame is
+    // still to come, for whatever the firmware does after the reset.
+    uint64_t wakeNs = std::max(timeNs, scheduled.front().timeNs);
+    timeNs = std::min(wakeNs, watchdogExpiryNs());
+    serviceWatchdog();
+
+    // The frame that wakes us is lost: the CAN peripheral has no clock in STOP.
+    timeNs = wakeNs;
+    scheduled.pop_front();
+
+    simEXTI.PR |= canRxMask;
+}
+
+/*
+ * Running
+ */
+
+uint32_t loopIterations()
+{
+    return iterations;
+}
+
+RunEnd runFirmware(const RunLimits& runLimits)
+{
+    limits = runLimits;
+
+    try
+    {
+        firmwareMain();
+    }
+    catch (const SimStop& stop)
+    {
+        return stop.reason;
+    }
+
+    return RunEnd::Limit;
+}
+
+// Called once per main loop iteration, at the command FIFO poll
+static void loopBoundary()
+{
+    if (timeNs >= limits.untilNs || (limits.maxIterations && iterations >= limits.maxIterations))
+    {
+        throw SimStop{ RunEnd::Limit };
+    }
+
+    if (limits.onIteration)
+    {
+        limits.onIteration(iterations);
+    }
+
+    iterations++;
+}
+
+/*
+ * ADC
+ */
+
+// 239.5 cycles sampling plus 12.5 converting, at 14MHz
+static constexpr uint64_t adcConversionNs = 18'000;
+
+static uint32_t supplyMv = 3300;
+static int32_t mcuTemperature = 25;
+static uint32_t vehicleMv = 13800;
+static uint32_t adcCcr = 0;
+static uint64_t adcStartNs = 0;
+static uint64_t adcConversions = 0;
+
+void setSupplyMv(uint32_t mv)
+{
+    supplyMv = mv;
+}
+
+void setMcuTemperature(int32_t celsius)
+{
+    mcuTemperature = celsius;
+}
+
+void setVehicleMv(uint32_t mv)
+{
+    vehicleMv = mv;
+}
+
+// What a conversion of a channel reads right now
+static adcsample_t adcReading(uint32_t channel)
+{
+    int32_t atCalibration = 0;
+
+    if (channel == 8)
+    {
+        // VBAT_SENSE, through the divider
+        atCalibration = vehicleMv / 11 * 4095 / 3300;
+    }
+    else if (channel == 16 && (adcCcr & ADC_CCR_TSEN))
+    {
+        atCalibration = simTsCal1 + (mcuTemperature - 30) * (simTsCal2 - simTsCal1) / (110 - 30);
+    }
+    else if (channel == 17 && (adcCcr & ADC_CCR_VREFEN))
+    {
+        atCalibration = simVrefintCal;
+    }
+
+    // Calibration was at 3.3V, readings scale inversely with the reference
+    int32_t reading = atCalibration * 3300 / static_cast<int32_t>(supplyMv);
+    return std::clamp(reading, 0, 4095);
+}
+
+static void serviceAdc()
+{
+    ADCDriver& adc = ADCD1;
+
+    if (adc.state != ADC_ACTIVE)
+    {
+        return;
+    }
+
+    const ADCConversionGroup& group = *adc.grpp;
+    size_t bufferSize = adc.depth * group.num_channels;
+    uint64_t due = (timeNs - adcStartNs) / adcConversionNs;
+
+    while (adcConversions < due && adc.state == ADC_ACTIVE)
+    {
+        // Selected channels convert in ascending order
+        size_t slot = adcConversions % bufferSize;
+        size_t nth = slot % group.num_channels;
+        uint32_t channel = 0;
+        for (uint32_t selected = group.chselr; ; selected &= selected - 1)
+        {
+            channel = __builtin_ctz(selected);
+            if (nth-- == 0)
+            {
+                break;
+            }
+        }
+
+        adc.samples[slot] = adcReading(channel);
+        adcConversions++;
+
+        // Callbacks at the half and full points, like the DMA interrupts
+        bool half = slot + 1 == bufferSize / 2 && adc.depth > 1;
+        bool full = slot + 1 == bufferSize;
+
+        if (full)
+        {
+            adc.state = ADC_COMPLETE;
+        }
+
+        if ((half || full) && group.end_cb)
+        {
+            group.end_cb(&adc);
+        }
+
+        if (full)
+        {
+            if (!group.circular)
+            {
+                adc.state = ADC_READY;
+                return;
+            }
+
+            adc.state = ADC_ACTIVE;
+        }
+    }
+}
+
+/*
+ * UART
+ */
+
+static std::vector<uint8_t> uartBytes;
+static uint64_t uartDoneNs = 0;
+
+const std::vector<uint8_t>& uartTx()
+{
+    return uartBytes;
+}
+
+static void serviceUart()
+{
+    UARTDriver& uart = UARTD1;
+
+    if (!uart.txactive || timeNs < uartDoneNs)
+    {
+        return;
+    }
+
+    uartBytes.insert(uartBytes.end(), uart.txbuf, uart.txbuf + uart.txsize);
+    uart.txactive = false;
+
+    // The DMA's done with the buffer
+    if (uart.config->txend1_cb)
+    {
+        uart.config->txend1_cb(&uart);
+    }
+}
+
+/*
+ * IWDG, clocked from a nominal 40kHz LSI
+ */
+
+static constexpr uint64_t lsiPeriodNs = 25'000;
+
+static bool watchdogRunning = false;
+static uint64_t watchdogTimeoutNs = 0;
+static uint64_t lastKickNs = 0;
+
+static void serviceWatchdog()
+{
+    if (watchdogRunning && timeNs - lastKickNs > watchdogTimeoutNs)
+    {
+        watchdogRunning = false;
+        simRCC.CSR = RCC_CSR_IWDGRSTF | RCC_CSR_PINRSTF;
+        throw SimStop{ RunEnd::Reset };
+    }
+}
+
+// First time the watchdog would go off if nobody kicks it
+static uint64_t watchdogExpiryNs()
+{
+    return watchdogRunning ? lastKickNs + watchdogTimeoutNs + 1 : UINT64_MAX;
+}
+
+} // namespace sim
+
+using namespace sim;
+
+/*
+ * ChibiOS/RT
+ */
+
+systime_t chVTGetSystemTimeX()
+{
+    return static_cast<systime_t>(timeNs / (1'000'000'000 / CH_CFG_ST_FREQUENCY));
+}
+
+void chSysInit()
+{
+}
+
+void chThdSleep(sysinterval_t time)
+{
+    advanceNs(static_cast<uint64_t>(time) * (1'000'000'000 / CH_CFG_ST_FREQUENCY));
+}
+
+/*
+ * HAL
+ */
+
+SYSCFG_TypeDef simSYSCFG;
+EXTI_TypeDef simEXTI;
+PWR_TypeDef simPWR;
+SCB_Type simSCB;
+TIM_TypeDef simTIM3;
+
+// Every boot in the simulator is from power on
+RCC_TypeDef simRCC = { RCC_CSR_PORRSTF | RCC_CSR_PINRSTF };
+
+// The linker script's stack symbols, filled the way crt0 would. The host
+// runs on its own stack, so these only give stacks.cpp something to read.
+asm(R"(
+    .data
+    .balign 4
+    .globl __main_stack_base__
+__main_stack_base__:
+    .fill 256, 4, 0x55555555
+    .globl __main_stack_end__
+__main_stack_end__:
+    .globl __process_stack_base__
+__process_stack_base__:
+    .fill 256, 4, 0x55555555
+    .globl __process_stack_end__
+__process_stack_end__:
+    .text
+)");
+
+static uint64_t timerTicks(const TIM_TypeDef& tim)
+{
+    return nowNs() * (STM32_TIMCLK1 / 1'000'000) / 1000 / (tim.PSC + 1);
+}
+
+SimTimerCount::operator uint32_t() const
+{
+    if (!(simTIM3.CR1 & TIM_CR1_CEN))
+    {
+        return 0;
+    }
+
+    return timerTicks(simTIM3) % (static_cast<uint64_t>(simTIM3.ARR) + 1);
+}
+
+namespace sim
+{
+
+// Raise the update interrupt once for every time TIM3 has wrapped
+static void serviceTimers()
+{
+    static uint64_t wrapsSeen = 0;
+
+    if (!(simTIM3.CR1 & TIM_CR1_CEN))
+    {
+        wrapsSeen = UINT64_MAX;
+        return;
+    }
+
+    uint64_t wraps = timerTicks(simTIM3) / (static_cast<uint64_t>(simTIM3.ARR) + 1);
+
+    // Just started counting, nothing to catch up on
+    if (wrapsSeen == UINT64_MAX)
+    {
+        wrapsSeen = wraps;
+    }
+
+    while (wrapsSeen < wraps)
+    {
+        wrapsSeen++;
+        simTIM3.SR |= TIM_SR_UIF;
+
+        if (simTIM3.DIER & TIM_DIER_UIE)
+        {
+            STM32_TIM3_HANDLER();
+        }
+    }
+}
+
+} // namespace sim
+
+CANDriver CAND1;
+
+ADCDriver ADCD1;
+
+const uint16_t simVrefintCal = 1526;
+const uint16_t simTsCal1 = 1755;
+const uint16_t simTsCal2 = 1325;
+
+void adcStart(ADCDriver* adcp, const ADCConfig*)
+{
+    adcp->state = ADC_READY;
+}
+
+void adcStartConversion(ADCDriver* adcp, const ADCConversionGroup* grpp, adcsample_t* samples, size_t depth)
+{
+    adcp->grpp = grpp;
+    adcp->samples = samples;
+    adcp->depth = depth;
+    adcp->state = ADC_ACTIVE;
+
+    adcStartNs = nowNs();
+    adcConversions = 0;
+}
+
+void adcStopConversion(ADCDriver* adcp)
+{
+    adcp->state = ADC_READY;
+}
+
+void adcSTM32SetCCR(uint32_t ccr)
+{
+    adcCcr = ccr;
+}
+
+UARTDriver UARTD1;
+
+void uartStart(UARTDriver* uartp, const UARTConfig* config)
+{
+    uartp->config = config;
+    uartp->txactive = false;
+}
+
+void uartStartSendI(UARTDriver* uartp, size_t n, const void* txbuf)
+{
+    uartp->txbuf = static_cast<const uint8_t*>(txbuf);
+    uartp->txsize = n;
+    uartp->txactive = true;
+
+    // 8N1, 10 bits a byte
+    uartDoneNs = nowNs() + n * 10 * 1'000'000'000ull / uartp->config->speed;
+}
+
+WDGDriver WDGD1;
+
+void wdgStart(WDGDriver* wdgp, const WDGConfig* config)
+{
+    wdgp->config = config;
+
+    watchdogRunning = true;
+    watchdogTimeoutNs = (4ull << config->pr) * (config->rlr + 1) * lsiPeriodNs;
+    lastKickNs = nowNs();
+}
+
+void wdgReset(WDGDriver*)
+{
+    lastKickNs = nowNs();
+}
+
+void halInit()
+{
+}
+
+void stm32_clock_init()
+{
+}
+
+void palSetLine(ioline_t line)
+{
+    lineState(line).latch = true;
+    propagateLines();
+}
+
+void palClearLine(ioline_t line)
+{
+    lineState(line).latch = false;
+    propagateLines();
+}
+
+int palReadLine(ioline_t line)
+{
+    return lineLevel(line) ? PAL_HIGH : PAL_LOW;
+}
+
+void palSetLineMode(ioline_t line, iomode_t mode)
+{
+    lineState(line).mode = mode;
+    propagateLines();
+}
+
+void canStart(CANDriver* canp, const CANConfig*)
+{
+    canp->started = true;
+    canp->asleep = false;
+}
+
+void canStop(CANDriver* canp)
+{
+    canp->started = false;
+}
+
+void canSTM32SetFilters(CANDriver*, uint32_t, uint32_t num, const CANFilter* cfp)
+{
+    filters.assign(cfp, cfp + num);
+}
+
+msg_t canReceiveTimeout(CANDriver* canp, canmbx_t mailbox, CANRxFrame* crfp, sysinterval_t)
+{
+    // Mailbox 1 is FIFO 0, our commands: the main loop polls it once per iteration
+    if (mailbox == 1)
+    {
+        loopBoundary();
+    }
+
+    deliverFrames();
+
+    if (!canp->started || canp->asleep)
+    {
+        return MSG_RESET;
+    }
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (mailbox != CAN_ANY_MAILBOX && mailbox != i + 1)
+        {
+            continue;
+        }
+
+        if (!fifos[i].empty())
+        {
+            *crfp = fifos[i].front();
+            fifos[i].pop_front();
+            return MSG_OK;
+        }
+    }
+
+    return MSG_TIMEOUT;
+}
+
+msg_t canTransmitTimeout(CANDriver* canp, canmbx_t, const CANTxFrame* ctfp, sysinterval_t)
+{
+    if (!canp->started || canp->asleep)
+    {
+        return MSG_RESET;
+    }
+
+    transmitted.push_back({ timeNs, *ctfp });
+    return MSG_OK;
+}
+
+void canSleep(CANDriver* canp)
+{
+    canp->asleep = true;
+}
+
+void canWakeup(CANDriver* canp)
+{
+    canp->asleep = false;
+}
+
+/*
+ * Core
+ */
+
+void __SEV()
+{
+    eventRegister = true;
+}
+
+void __WFE()
+{
+    if (eventRegister)
+    {
+        eventRegister = false;
+        return;
+    }
+
+    sleepUntilEvent();
+}
+
+uint32_t __get_IPSR()
+{
+    return 0;
+}
+
+void NVIC_SystemReset()
+{
+    simRCC.CSR = RCC_CSR_SFTRSTF | RCC_CSR_PINRSTF;
+    throw SimStop{ RunEnd::Reset };
+}
@@ -0,0 +1,81 @@
+/**
+ * @file        sim_main.cpp
+ * @brief       Boot the firmware on the host and print what it sends on CAN
+ *
+ * usage: swc_sim [run time ms] [max loop iterations] [telemetry file]
+ *
+ * Both wings are populated with simulated PCA9557s, no buttons pressed.
+ * The raw USART telemetry stream is written to the telemetry file if given,
+ * ready for swc_telemetry.
+ */
+
+#include "sim.h"
+#include "sim_wing.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static const char* runEndName(sim::RunEnd end)
+{
+    switch (end)
+    {
+        case sim::RunEnd::Limit: return "limit";
+        case sim::RunEnd::Asleep: return "asleep";
+        case sim::RunEnd::Reset: return "reset";
+    }
+
+    return "?";
+}
+
+int main(int argc, char** argv)
+{
+    sim::RunLimits limits;
+
+    if (argc > 1)
+    {
+        limits.untilNs = strtoull(argv[1], nullptr, 0) * 1'000'000;
+    }
+
+    if (argc > 2)
+    {
+        limits.maxIterations = strtoul(argv[2], nullptr, 0);
+    }
+
+    // Same pins as the wing topology in main.cpp
+    SimWing left(PAL_LINE(GPIOB, 6), PAL_LINE(GPIOB, 7));
+    SimWing right(PAL_LINE(GPIOB, 10), PAL_LINE(GPIOB, 11));
+    left.SetButtons(0);
+    right.SetButtons(0);
+
+    sim::RunEnd end = sim::runFirmware(limits);
+
+    // candump -L style, so the output can be fed to the usual tools
+    for (const auto& tx : sim::txFrames())
+    {
+        printf("(%llu.%06llu) sim %03X#", (unsigned long long)(tx.timeNs / 1'000'000'000), (unsigned long long)(tx.timeNs / 1000 % 1'000'000), (unsigned)tx.frame.SID);
+
+        for (size_t i = 0; i < tx.frame.DLC; i++)
+        {
+            printf("%02X", tx.frame.data8[i]);
+        }
+
+        printf("\n");
+    }
+
+    if (argc > 3)
+    {
+        FILE* f = fopen(argv[3], "wb");
+        if (!f)
+        {
+            perror(argv[3]);
+            return 1;
+        }
+
+        fwrite(sim::uartTx().data(), 1, sim::uartTx().size(), f);
+        fclose(f);
+    }
+
+    fprintf(stderr, "ended: %s after %u loop iterations, %.3f ms\n", runEndName(end), sim::loopIterations(), sim::nowNs() / 1e6);
+
+    return 0;
+}
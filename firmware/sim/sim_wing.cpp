@@ -0,0 +1,65 @@
+/**
+ * @file        sim_wing.cpp
+ * @brief       A simulated wing: three PCA9557s on one bit-banged bus
+ */
+
+#include "sim_wing.h"
+
+static constexpr bool getbit(uint8_t val, uint8_t bit)
+{
+    return (val >> bit) & 0x1;
+}
+
+static constexpr uint8_t setbit(bool val, uint8_t bit)
+{
+    return val ? (1 << bit) : 0;
+}
+
+SimWing::SimWing(ioline_t scl, ioline_t sda)
+{
+    for (size_t i = 0; i < chipCount; i++)
+    {
+        m_chips[i] = std::make_unique<Pca9557Model>(scl, sda, i);
+    }
+}
+
+// The pin map here is written out by hand rather than taken from
+// wing_layout.h, so that a mistake in the table shows up in the simulator.
+void SimWing::SetButtons(uint8_t buttons)
+{
+    // Chip 1 bits 5, 6 are buttons 1, 2
+    // Chip 3 bits 0, 6, 3 are buttons 3, 4, 5
+    uint8_t c1 = 0xFF & ~((1 << 5) | (1 << 6));
+    c1 |= setbit(getbit(buttons, 0), 5);
+    c1 |= setbit(getbit(buttons, 1), 6);
+
+    uint8_t c3 = 0xFF & ~((1 << 0) | (1 << 6) | (1 << 3));
+    c3 |= setbit(getbit(buttons, 2), 0);
+    c3 |= setbit(getbit(buttons, 3), 6);
+    c3 |= setbit(getbit(buttons, 4), 3);
+
+    m_chips[0]->SetPinInputs(c1);
+    m_chips[2]->SetPinInputs(c3);
+}
+
+uint8_t SimWing::GetLeds() const
+{
+    // Chip 1 bits 4, 7 are LEDs 1, 2
+    // Chip 3 bits 1, 7, 2 are LEDs 3, 4, 5
+    uint8_t c1 = m_chips[0]->PinOutputs();
+    uint8_t c3 = m_chips[2]->PinOutputs();
+
+    return setbit(getbit(c1, 4), 0)
+         | setbit(getbit(c1, 7), 1)
+         | setbit(getbit(c3, 1), 2)
+         | setbit(getbit(c3, 7), 3)
+         | setbit(getbit(c3, 2), 4);
+}
+
+void SimWing::SetDisconnected(bool disconnected)
+{
+    for (auto& chip : m_chips)
+    {
+        chip->SetDisconnected(disconnected);
+    }
+}
@@ -0,0 +1,39 @@
+/**
+ * @file        sim_wing.h
+ * @brief       A simulated wing: three PCA9557s on one bit-banged bus
+ *
+ * Knows the wing's board layout, so tests can press logical buttons and
+ * see logical LEDs the same way Wing::ReadButtons and Wing::WriteLeds
+ * number them.
+ */
+
+#pragma once
+
+#include "pca9557_model.h"
+
+#include <memory>
+
+class SimWing
+{
+public:
+    SimWing(ioline_t scl, ioline_t sda);
+
+    // Set the button inputs, bit 0 is button 1 (as returned by Wing::ReadButtons)
+    void SetButtons(uint8_t buttons);
+
+    // Which LEDs are lit right now, bit 0 is LED 1 (as passed to Wing::WriteLeds)
+    uint8_t GetLeds() const;
+
+    Pca9557Model& Chip(size_t index)
+    {
+        return *m_chips[index];
+    }
+
+    static constexpr size_t chipCount = 3;
+
+    // Apply a fault to every chip, like the whole harness going open circuit
+    void SetDisconnected(bool disconnected);
+
+private:
+    std::unique_ptr<Pca9557Model> m_chips[chipCount];
+};
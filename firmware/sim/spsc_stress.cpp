@@ -0,0 +1,212 @@
+/**
+ * @file        spsc_stress.cpp
+ * @brief       Two-thread stress test of SpscRing
+ *
+ * usage: swc_spsc_stress [items]
+ *
+ * A producer thread pushes a counting sequence, a consumer thread takes it
+ * off and checks nothing is lost, repeated or reordered. Each side picks at
+ * random between its single-item and its bulk calls (Push or Reserved and
+ * Commit, Pop or Contiguous and Consume), and the indices start just short
+ * of 2^32 so the run goes across the index wrap as well as the buffer wrap.
+ *
+ * Exits nonzero on the first wrong item.
+ */
+
+#include "spsc_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+// Small, so both sides keep running into full and empty
+static constexpr size_t ringSize = 16;
+static constexpr uint32_t startIndex = UINT32_MAX - 1000;
+
+using Ring = SpscRing<uint32_t, ringSize>;
+
+static uint32_t xorshift(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// The indices don't say how many items have gone by, so check the wrap was
+// actually crossed from outside
+static bool indicesWrap(uint32_t items)
+{
+    return static_cast<uint32_t>(startIndex + items) < startIndex;
+}
+
+// Single threaded: Contiguous stops at the end of the buffer, then carries
+// on from the start
+static bool checkContiguous()
+{
+    Ring ring(startIndex);
+
+    // Move the tail to 4 slots before the end of the buffer
+    size_t skip = ringSize - 4 - (startIndex & (ringSize - 1));
+    for (size_t i = 0; i < skip; i++)
+    {
+        uint32_t item;
+        ring.Push(0);
+        ring.Pop(item);
+    }
+
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        ring.Push(i);
+    }
+
+    const uint32_t* data;
+    size_t run = ring.Contiguous(data);
+
+    if (run != 4 || data[0] != 0 || data[3] != 3)
+    {
+        printf("contiguous before the buffer end: got %zu\n", run);
+        return false;
+    }
+
+    ring.Consume(run);
+    run = ring.Contiguous(data);
+
+    if (run != 6 || data[0] != 4 || data[5] != 9)
+    {
+        printf("contiguous after the buffer end: got %zu\n", run);
+        return false;
+    }
+
+    ring.Consume(run);
+
+    if (ring.Available() != 0 || ring.Free() != ringSize)
+    {
+        printf("not empty after consuming everything\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t items = argc > 1 ? strtoul(argv[1], nullptr, 0) : 10'000'000;
+
+    if (!checkContiguous())
+    {
+        return 1;
+    }
+
+    Ring ring(startIndex);
+    std::atomic<bool> failed = false;
+
+    std::thread producer([&]()
+    {
+        uint32_t state = 0x12345678;
+        uint32_t next = 0;
+
+        while (next < items && !failed)
+        {
+            // Let the consumer run if it's on the same core
+            if (ring.Free() == 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (xorshift(state) & 1)
+            {
+                if (ring.Push(next))
+                {
+                    next++;
+                }
+
+                continue;
+            }
+
+            size_t count = xorshift(state) % ringSize + 1;
+            count = std::min<size_t>({ count, ring.Free(), items - next });
+
+            // Fill back to front, the consumer mustn't see any of it early
+            for (size_t i = count; i-- > 0;)
+            {
+                ring.Reserved(i) = next + i;
+            }
+
+            ring.Commit(count);
+            next += count;
+        }
+    });
+
+    uint32_t state = 0x9abcdef0;
+    uint32_t expected = 0;
+    uint64_t bulkRuns = 0;
+
+    while (expected < items && !failed)
+    {
+        if (ring.Available() == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (xorshift(state) & 1)
+        {
+            uint32_t item;
+
+            if (ring.Pop(item))
+            {
+                if (item != expected)
+                {
+                    printf("pop: expected %u, got %u\n", expected, item);
+                    failed = true;
+                }
+
+                expected++;
+            }
+
+            continue;
+        }
+
+        const uint32_t* data;
+        size_t run = ring.Contiguous(data);
+
+        // Sometimes leave some behind, so the next run starts mid buffer
+        if (run > 1 && (xorshift(state) & 1))
+        {
+            run = run / 2;
+        }
+
+        for (size_t i = 0; i < run && !failed; i++)
+        {
+            if (data[i] != expected + i)
+            {
+                printf("contiguous: expected %u, got %u\n", static_cast<uint32_t>(expected + i), data[i]);
+                failed = true;
+            }
+        }
+
+        ring.Consume(run);
+        expected += run;
+        bulkRuns += run != 0;
+    }
+
+    producer.join();
+
+    if (failed)
+    {
+        return 1;
+    }
+
+    if (!indicesWrap(items))
+    {
+        printf("warning: %u items don't take the indices across the wrap\n", items);
+    }
+
+    printf("spsc ring: %u items ok, %llu bulk runs\n", items, static_cast<unsigned long long>(bulkRuns));
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file        telemetry_decode.cpp
+ * @brief       Decode the USART telemetry stream into one line per record
+ *
+ * usage: swc_telemetry <file or serial device>
+ *
+ * Reads until end of file, so it runs forever on a serial device. Set the
+ * port up first, eg: stty -F /dev/ttyUSB0 460800 raw
+ *
+ * Records that fail COBS decoding or their CRC are counted and skipped, and
+ * decoding picks up again at the next delimiter.
+ */
+
+#include "framing.h"
+#include "telemetry.h"
+#include "profiler.h"
+
+#include <cstdio>
+#include <vector>
+
+static const char* phaseNames[] = { "liveness", "buttons", "knob", "can_rx", "leds", "can_tx", "loop" };
+static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) == static_cast<size_t>(LoopPhase::Count));
+
+static uint16_t get16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void printRecord(const uint8_t* record, size_t size)
+{
+    auto type = static_cast<TelemetryType>(record[0]);
+    const uint8_t* payload = record + 1;
+    size_t payloadSize = size - 1;
+
+    switch (type)
+    {
+        case TelemetryType::Dropped:
+            if (payloadSize == 2)
+            {
+                printf("dropped %u\n", get16(payload));
+                return;
+            }
+            break;
+        case TelemetryType::LoopTiming:
+            if (payloadSize == 2 * static_cast<size_t>(LoopPhase::Count))
+            {
+                printf("loop");
+                for (size_t i = 0; i < static_cast<size_t>(LoopPhase::Count); i++)
+                {
+                    printf(" %s=%u", phaseNames[i], get16(payload + 2 * i));
+                }
+                printf("\n");
+                return;
+            }
+            break;
+        case TelemetryType::ExpanderInputs:
+            if (payloadSize == 3)
+            {
+                printf("inputs wing=%u raw=%04X\n", payload[0], payload[1] | payload[2] << 8);
+                return;
+            }
+            break;
+        case TelemetryType::WingLink:
+            if (payloadSize == 3)
+            {
+                printf("link wing=%u alive=%u expanders=%02x\n", payload[0], payload[1], payload[2]);
+                return;
+            }
+            break;
+    }
+
+    printf("unknown type=%u size=%zu\n", record[0], payloadSize);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <file or serial device>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> encoded;
+    uint8_t record[1 + telemetryMaxPayload + 2];
+    uint32_t good = 0;
+    uint32_t bad = 0;
+
+    int c;
+    while ((c = fgetc(in)) != EOF)
+    {
+        if (c != 0)
+        {
+            encoded.push_back(c);
+            continue;
+        }
+
+        // Back to back delimiters, eg when joining the stream midway
+        if (encoded.empty())
+        {
+            continue;
+        }
+
+        size_t size = cobsDecode(encoded.data(), encoded.size(), record, sizeof(record));
+        encoded.clear();
+
+        if (size < 3 || crc16(record, size - 2) != get16(record + size - 2))
+        {
+            bad++;
+            continue;
+        }
+
+        good++;
+        printRecord(record, size - 2);
+        fflush(stdout);
+    }
+
+    fclose(in);
+
+    fprintf(stderr, "%u records, %u bad\n", good, bad);
+
+    return 0;
+}
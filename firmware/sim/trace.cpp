@@ -0,0 +1,148 @@
+/**
+ * @file        trace.cpp
+ * @brief       Golden I2C waveform check for the Wing operations
+ *
+ * usage: swc_trace <golden dir> [--update] [--vcd <dir>]
+ *
+ * Records the waveform of each Wing operation against a simulated wing,
+ * checks it against the I2C timing rules, and compares it with the golden
+ * trace stored in the given directory. --update rewrites the golden traces
+ * instead (after a deliberate change to the bus timing). --vcd also writes
+ * a VCD per operation for a waveform viewer.
+ *
+ * Exits nonzero if any rule is broken or any trace differs.
+ */
+
+#include "sim.h"
+#include "sim_wing.h"
+#include "trace_recorder.h"
+
+#include "wing.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+
+static const ioline_t scl = PAL_LINE(GPIOB, 6);
+static const ioline_t sda = PAL_LINE(GPIOB, 7);
+
+struct Operation
+{
+    const char* name;
+    std::function<void()> run;
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <golden dir> [--update] [--vcd <dir>]\n", argv[0]);
+        return 2;
+    }
+
+    std::string goldenDir = argv[1];
+    bool update = false;
+    const char* vcdDir = nullptr;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--update"))
+        {
+            update = true;
+        }
+        else if (!strcmp(argv[i], "--vcd") && i + 1 < argc)
+        {
+            vcdDir = argv[++i];
+        }
+    }
+
+    SimWing simWing(scl, sda);
+    simWing.SetButtons(0x15);
+
+    Wing wing({ scl, sda });
+    TraceRecorder recorder(scl, sda);
+
+    // Each operation runs on the state the previous one left behind
+    const Operation operations[] =
+    {
+        { "init", [&]() { wing.Init(); } },
+        { "scrub", [&]() { wing.Scrub(); } },
+        { "read_buttons", [&]() { wing.ReadButtons(); } },
+        { "write_leds", [&]() { wing.WriteLeds(0x15); } },
+    };
+
+    int failures = 0;
+
+    for (const auto& op : operations)
+    {
+        recorder.Clear();
+        op.run();
+
+        const Trace& trace = recorder.GetTrace();
+
+        for (const auto& violation : checkI2cTiming(trace))
+        {
+            printf("%s: %s\n", op.name, violation.c_str());
+            failures++;
+        }
+
+        if (vcdDir)
+        {
+            std::string path = std::string(vcdDir) + "/" + op.name + ".vcd";
+            if (FILE* f = fopen(path.c_str(), "w"))
+            {
+                writeVcd(f, trace, op.name);
+                fclose(f);
+            }
+        }
+
+        std::string goldenPath = goldenDir + "/" + op.name + ".trace";
+
+        if (update)
+        {
+            FILE* f = fopen(goldenPath.c_str(), "w");
+            if (!f)
+            {
+                printf("%s: can't write %s\n", op.name, goldenPath.c_str());
+                failures++;
+                continue;
+            }
+
+            writeTrace(f, trace);
+            fclose(f);
+            printf("%s: wrote %zu events\n", op.name, trace.size());
+            continue;
+        }
+
+        Trace golden;
+        FILE* f = fopen(goldenPath.c_str(), "r");
+        if (!f || !readTrace(f, golden))
+        {
+            printf("%s: can't read %s\n", op.name, goldenPath.c_str());
+            failures++;
+
+            if (f)
+            {
+                fclose(f);
+            }
+
+            continue;
+        }
+
+        fclose(f);
+
+        std::string diff = diffTraces(golden, trace);
+        if (!diff.empty())
+        {
+            printf("%s: differs from golden, %s\n", op.name, diff.c_str());
+            failures++;
+        }
+        else
+        {
+            printf("%s: ok, %zu events\n", op.name, trace.size());
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+/**
+ * @file        trace_recorder.cpp
+ * @brief       Record, check and compare I2C waveforms on a simulated bus
+ */
+
+#include "trace_recorder.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+TraceRecorder::TraceRecorder(ioline_t scl, ioline_t sda)
+    : m_scl(scl)
+    , m_sda(sda)
+{
+    sim::attachDevice(this, scl);
+    sim::attachDevice(this, sda);
+
+    Clear();
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    sim::detachDevice(this);
+}
+
+void TraceRecorder::Clear()
+{
+    m_trace.clear();
+    m_originNs = sim::nowNs();
+}
+
+void TraceRecorder::onLineChange(ioline_t line, bool level)
+{
+    uint64_t time = (sim::nowNs() - m_originNs) / sim::quarterBitNs();
+
+    m_trace.push_back({ time, line == m_sda, level });
+}
+
+void writeVcd(FILE* f, const Trace& trace, const char* scope)
+{
+    fprintf(f, "$comment swc simulator, 1 quarter bit = %u ns $end\n", sim::quarterBitNs());
+    fprintf(f, "$timescale 1 ns $end\n");
+    fprintf(f, "$scope module %s $end\n", scope);
+    fprintf(f, "$var wire 1 c scl $end\n");
+    fprintf(f, "$var wire 1 d sda $end\n");
+    fprintf(f, "$upscope $end\n");
+    fprintf(f, "$enddefinitions $end\n");
+
+    // Both lines idle high
+    fprintf(f, "#0\n$dumpvars\n1c\n1d\n$end\n");
+
+    uint64_t lastTime = UINT64_MAX;
+
+    for (const auto& e : trace)
+    {
+        if (e.time != lastTime)
+        {
+            fprintf(f, "#%" PRIu64 "\n", e.time * sim::quarterBitNs());
+            lastTime = e.time;
+        }
+
+        fprintf(f, "%d%c\n", e.level ? 1 : 0, e.sda ? 'd' : 'c');
+    }
+}
+
+void writeTrace(FILE* f, const Trace& trace)
+{
+    for (const auto& e : trace)
+    {
+        fprintf(f, "%" PRIu64 " %s %d\n", e.time, e.sda ? "SDA" : "SCL", e.level ? 1 : 0);
+    }
+}
+
+bool readTrace(FILE* f, Trace& trace)
+{
+    trace.clear();
+
+    uint64_t time;
+    char line[4];
+    int level;
+
+    while (fscanf(f, "%" SCNu64 " %3s %d", &time, line, &level) == 3)
+    {
+        trace.push_back({ time, line[1] == 'D', level != 0 });
+    }
+
+    return feof(f);
+}
+
+// Minimums, in quarter bits
+static constexpr uint64_t minSclHigh = 1;    // tHIGH
+static constexpr uint64_t minSclLow = 2;     // tLOW
+static constexpr uint64_t minDataSetup = 1;  // tSU;DAT
+static constexpr uint64_t minStartSetup = 1; // tSU;STA
+static constexpr uint64_t minStartHold = 1;  // tHD;STA
+static constexpr uint64_t minStopSetup = 1;  // tSU;STO
+static constexpr uint64_t minBusFree = 1;    // tBUF
+
+std::vector<std::string> checkI2cTiming(const Trace& trace)
+{
+    std::vector<std::string> violations;
+
+    auto fail = [&](uint64_t time, const char* what, uint64_t actual, uint64_t min)
+    {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "t=%" PRIu64 ": %s is %" PRIu64 " quarter bits, needs %" PRIu64, time, what, actual, min);
+        violations.push_back(buf);
+    };
+
+    bool scl = true;
+    bool sda = true;
+
+    uint64_t sclChanged = 0;
+    uint64_t sdaChanged = 0;
+    bool sdaChangedWhileLow = false;
+
+    bool inTransaction = false;
+    uint64_t startTime = 0;
+    uint64_t stopTime = 0;
+    bool haveStop = false;
+    uint32_t clocks = 0;
+
+    for (const auto& e : trace)
+    {
+        if (!e.sda)
+        {
+            if (e.level == scl)
+            {
+                continue;
+            }
+
+            if (e.level)
+            {
+                if (e.time - sclChanged < minSclLow)
+                {
+                    fail(e.time, "SCL low time", e.time - sclChanged, minSclLow);
+                }
+
+                if (sdaChangedWhileLow && e.time - sdaChanged < minDataSetup)
+                {
+                    fail(e.time, "data setup time", e.time - sdaChanged, minDataSetup);
+                }
+
+                clocks++;
+            }
+            else
+            {
+                if (e.time - sclChanged < minSclHigh)
+                {
+                    fail(e.time, "SCL high time", e.time - sclChanged, minSclHigh);
+                }
+
+                if (inTransaction && clocks == 0 && e.time - startTime < minStartHold)
+                {
+                    fail(e.time, "start hold time", e.time - startTime, minStartHold);
+                }
+            }
+
+            scl = e.level;
+            sclChanged = e.time;
+            sdaChangedWhileLow = false;
+            continue;
+        }
+
+        if (e.level == sda)
+        {
+            continue;
+        }
+
+        sda = e.level;
+        sdaChanged = e.time;
+
+        if (!scl)
+        {
+            sdaChangedWhileLow = true;
+            continue;
+        }
+
+        // SDA changing while SCL is high is a start or a stop, and it has to land on a byte boundary.
+        // The clock that raises SCL for a stop or repeated start doesn't carry data.
+        if (inTransaction && clocks > 0 && (clocks - 1) % 9 != 0)
+        {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "t=%" PRIu64 ": %s after %u clocks, not on a byte boundary", e.time, sda ? "stop" : "start", clocks - 1);
+            violations.push_back(buf);
+        }
+
+        if (!sda)
+        {
+            // Start or repeated start
+            if (e.time - sclChanged < minStartSetup)
+            {
+                fail(e.time, "start setup time", e.time - sclChanged, minStartSetup);
+            }
+
+            if (!inTransaction && haveStop && e.time - stopTime < minBusFree)
+            {
+                fail(e.time, "bus free time", e.time - stopTime, minBusFree);
+            }
+
+            inTransaction = true;
+            startTime = e.time;
+            clocks = 0;
+        }
+        else
+        {
+            // Stop
+            if (e.time - sclChanged < minStopSetup)
+            {
+                fail(e.time, "stop setup time", e.time - sclChanged, minStopSetup);
+            }
+
+            inTransaction = false;
+            haveStop = true;
+            stopTime = e.time;
+            clocks = 0;
+        }
+    }
+
+    return violations;
+}
+
+std::string diffTraces(const Trace& expected, const Trace& actual)
+{
+    char buf[160];
+
+    size_t n = std::min(expected.size(), actual.size());
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const auto& a = expected[i];
+        const auto& b = actual[i];
+
+        if (!(a == b))
+        {
+            snprintf(buf, sizeof(buf), "event %zu: expected %" PRIu64 " %s %d, got %" PRIu64 " %s %d",
+                i, a.time, a.sda ? "SDA" : "SCL", a.level, b.time, b.sda ? "SDA" : "SCL", b.level);
+            return buf;
+        }
+    }
+
+    if (expected.size() != actual.size())
+    {
+        snprintf(buf, sizeof(buf), "expected %zu events, got %zu", expected.size(), actual.size());
+        return buf;
+    }
+
+    return {};
+}
@@ -0,0 +1,77 @@
+/**
+ * @file        trace_recorder.h
+ * @brief       Record, check and compare I2C waveforms on a simulated bus
+ *
+ * Every SCL/SDA transition is logged with a virtual timestamp in quarter
+ * bit units (see BitbangI2c::waitQuarterBit). Traces can be written as VCD
+ * for a waveform viewer, or as text for golden comparisons.
+ */
+
+#pragma once
+
+#include "sim.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct TraceEvent
+{
+    // Quarter bits since the recording started
+    uint64_t time;
+    // false for SCL, true for SDA
+    bool sda;
+    bool level;
+
+    bool operator==(const TraceEvent& other) const
+    {
+        return time == other.time && sda == other.sda && level == other.level;
+    }
+};
+
+using Trace = std::vector<TraceEvent>;
+
+class TraceRecorder : public sim::BusDevice
+{
+public:
+    TraceRecorder(ioline_t scl, ioline_t sda);
+    ~TraceRecorder();
+
+    // Throw away what's been recorded, and start the clock from now
+    void Clear();
+
+    const Trace& GetTrace() const
+    {
+        return m_trace;
+    }
+
+    // sim::BusDevice
+    void onLineChange(ioline_t line, bool level) override;
+
+    bool pullsDown(ioline_t) const override
+    {
+        return false;
+    }
+
+private:
+    const ioline_t m_scl;
+    const ioline_t m_sda;
+
+    uint64_t m_originNs = 0;
+    Trace m_trace;
+};
+
+// Value Change Dump, timescale is real time at the current quarter bit length
+void writeVcd(FILE* f, const Trace& trace, const char* scope);
+
+// One event per line: "<time> SCL|SDA 0|1"
+void writeTrace(FILE* f, const Trace& trace);
+bool readTrace(FILE* f, Trace& trace);
+
+// Check a trace against the I2C rules the bit-bang driver has to keep,
+// all in quarter bits. Returns a description of each violation.
+std::vector<std::string> checkI2cTiming(const Trace& trace);
+
+// Returns an empty string if the traces match, otherwise where they first differ
+std::string diffTraces(const Trace& expected, const Trace& actual);
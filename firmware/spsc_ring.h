@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Single producer, single consumer ring buffer, for passing data between an
+// ISR and a thread (or a thread and a DMA) without locking.
+//
+// ARMv6-M has no exclusive load/store, so nothing here is a read-modify-write:
+// each index is an aligned word that only one side ever writes, with plain
+// loads and stores. The release store of an index publishes the slots before
+// it, the acquire load on the other side sees them. Indices run freely and
+// wrap at 2^32, which is why N must be a power of 2.
+template<typename T, size_t N>
+class SpscRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ring size must be a power of 2");
+    static_assert(N <= (1u << 31), "ring too big for the index arithmetic");
+
+public:
+    static constexpr size_t Capacity = N;
+
+    // Tests start the indices just short of the wrap, everything else at 0
+    constexpr explicit SpscRing(uint32_t start = 0)
+        : m_head(start)
+        , m_tail(start)
+    {
+    }
+
+    /*
+     * Producer side
+     */
+
+    // Slots the producer can fill right now
+    size_t Free() const
+    {
+        return N - (m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire));
+    }
+
+    bool Push(const T& item)
+    {
+        if (Free() == 0)
+        {
+            return false;
+        }
+
+        Reserved(0) = item;
+        Commit(1);
+        return true;
+    }
+
+    // Fill slots in place before committing them, in any order. Only valid
+    // for offset < Free(). The consumer can't see them until Commit.
+    T& Reserved(size_t offset)
+    {
+        return m_buffer[(m_head.load(std::memory_order_relaxed) + offset) & (N - 1)];
+    }
+
+    // Publish the next count reserved slots to the consumer
+    void Commit(size_t count)
+    {
+        m_head.store(m_head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    /*
+     * Consumer side
+     */
+
+    // Slots the consumer can take right now
+    size_t Available() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed);
+    }
+
+    bool Pop(T& item)
+    {
+        if (Available() == 0)
+        {
+            return false;
+        }
+
+        item = m_buffer[m_tail.load(std::memory_order_relaxed) & (N - 1)];
+        Consume(1);
+        return true;
+    }
+
+    // The longest run of available slots that doesn't wrap, for handing
+    // straight to a DMA. Returns how many, 0 if empty.
+    size_t Contiguous(const T*& data) const
+    {
+        size_t available = Available();
+        size_t start = m_tail.load(std::memory_order_relaxed) & (N - 1);
+        size_t run = N - start;
+
+        data = &m_buffer[start];
+        return available < run ? available : run;
+    }
+
+    // Hand back slots the consumer is done with
+    void Consume(size_t count)
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+private:
+    T m_buffer[N];
+
+    // Written only by the producer
+    std::atomic<uint32_t> m_head;
+    // Written only by the consumer
+    std::atomic<uint32_t> m_tail;
+};
@@ -0,0 +1,75 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "stacks.h"
+#include "report.h"
+
+// Linker symbols bounding each stack, crt0 fills them with the pattern at boot
+extern "C" uint32_t __main_stack_base__[];
+extern "C" uint32_t __main_stack_end__[];
+extern "C" uint32_t __process_stack_base__[];
+extern "C" uint32_t __process_stack_end__[];
+
+// Matches CRT0_STACKS_FILL_PATTERN, and CH_DBG_STACK_FILL_VALUE for threads
+static constexpr uint32_t stackFillPattern = 0x55555555;
+
+struct StackRegion
+{
+    const uint32_t* base;
+    const uint32_t* end;
+};
+
+// In StackId order. Any thread added later gets its working area listed here.
+static const StackRegion stacks[] = {
+    { __main_stack_base__, __main_stack_end__ },
+    { __process_stack_base__, __process_stack_end__ },
+};
+
+static_assert(sizeof(stacks) / sizeof(stacks[0]) == static_cast<size_t>(StackId::Count));
+
+static ReportCursor<static_cast<size_t>(StackId::Count)> report;
+
+uint32_t getStackSize(StackId id)
+{
+    const StackRegion& s = stacks[static_cast<size_t>(id)];
+
+    return (s.end - s.base) * sizeof(uint32_t);
+}
+
+uint32_t getStackPeakUsage(StackId id)
+{
+    const StackRegion& s = stacks[static_cast<size_t>(id)];
+
+    // Stacks grow down, so the untouched part is at the bottom
+    const uint32_t* p = s.base;
+    while (p < s.end && *p == stackFillPattern)
+    {
+        p++;
+    }
+
+    return (s.end - p) * sizeof(uint32_t);
+}
+
+void requestStackReport()
+{
+    report.Start();
+}
+
+bool serviceStackReport()
+{
+    if (!report.Active())
+    {
+        return false;
+    }
+
+    auto id = static_cast<StackId>(report.Index());
+    uint16_t size = getStackSize(id);
+    uint16_t peak = getStackPeakUsage(id);
+
+    // Stack, then size and peak usage in bytes
+    DiagPayload().U8(report.Index()).U16(size).U16(peak).Send(DiagType::StackUsage);
+
+    report.Advance();
+
+    return true;
+}
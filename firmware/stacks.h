@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+enum class StackId : uint8_t
+{
+    // MSP, used by interrupts and exceptions
+    Exceptions,
+    // PSP, used by the main() thread
+    Main,
+
+    Count,
+};
+
+// Bytes of the stack that have ever been used, found from how much of the
+// fill pattern written at boot has been overwritten
+uint32_t getStackSize(StackId id);
+uint32_t getStackPeakUsage(StackId id);
+
+// Queue up the high water marks to go out as diagnostic frames, one stack per loop iteration
+void requestStackReport();
+
+// Send the next queued stack frame, if any. Returns true if a frame was sent.
+bool serviceStackReport();
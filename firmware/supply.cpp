@@ -0,0 +1,199 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "supply.h"
+#include "report.h"
+
+#ifndef SWC_SIMULATOR
+// Factory calibration in system memory, taken at 3.3V. TS_CAL1 is at 30C, TS_CAL2 at 110C.
+#define VREFINT_CAL (*reinterpret_cast<const uint16_t*>(0x1FFFF7BA))
+#define TS_CAL1 (*reinterpret_cast<const uint16_t*>(0x1FFFF7B8))
+#define TS_CAL2 (*reinterpret_cast<const uint16_t*>(0x1FFFF7C2))
+#endif
+
+static constexpr uint32_t calibrationMv = 3300;
+
+// VBAT_SENSE on PB0 (ADC_IN8), the vehicle supply through R2 100k over R3 10k
+#define VBAT_SENSE_LINE PAL_LINE(GPIOB, 0)
+static constexpr uint32_t vbatDividerRatio = 11;
+static constexpr uint32_t adcFullScale = 4095;
+
+// Channels convert in ascending order, so the buffer goes vbat, temp, vref, vbat...
+static constexpr size_t channelCount = 3;
+static constexpr size_t vbatIndex = 0;
+static constexpr size_t tempIndex = 1;
+static constexpr size_t vrefIndex = 2;
+
+// The callback runs at each half of the buffer, every ~900us
+static constexpr size_t bufferDepth = 32;
+static constexpr size_t samplesPerHalf = bufferDepth / 2;
+
+static adcsample_t samples[bufferDepth * channelCount];
+
+static constexpr sysinterval_t reportInterval = TIME_S2I(1);
+
+// Sums of samplesPerHalf samples, smoothed over a few halves in the callback
+static constexpr uint32_t smoothingShift = 3;
+static volatile uint32_t vbatAverage = 0;
+static volatile uint32_t tempAverage = 0;
+static volatile uint32_t vrefAverage = 0;
+
+// Lowest unsmoothed vehicle supply since the last report, 0 if none yet
+static volatile uint16_t vbatLowMv = 0;
+
+static systime_t lastReport = 0;
+
+static uint16_t vrefToMv(uint32_t vrefSum)
+{
+    if (vrefSum == 0)
+    {
+        return 0;
+    }
+
+    return calibrationMv * VREFINT_CAL * samplesPerHalf / vrefSum;
+}
+
+// VBAT_SENSE is measured against VDDA, which vref tells us
+static uint16_t vbatToMv(uint32_t vbatSum, uint32_t vrefSum)
+{
+    return vrefToMv(vrefSum) * vbatSum * vbatDividerRatio / (adcFullScale * samplesPerHalf);
+}
+
+static void adcCallback(ADCDriver* adcp)
+{
+    // Which half just filled
+    const adcsample_t* half = adcIsBufferComplete(adcp) ? &samples[samplesPerHalf * channelCount] : samples;
+
+    uint32_t vbatSum = 0;
+    uint32_t tempSum = 0;
+    uint32_t vrefSum = 0;
+
+    for (size_t i = 0; i < samplesPerHalf; i++)
+    {
+        vbatSum += half[i * channelCount + vbatIndex];
+        tempSum += half[i * channelCount + tempIndex];
+        vrefSum += half[i * channelCount + vrefIndex];
+    }
+
+    // First time through, start the averages from here rather than ramping up from 0
+    if (vrefAverage == 0)
+    {
+        vbatAverage = vbatSum;
+        tempAverage = tempSum;
+        vrefAverage = vrefSum;
+    }
+    else
+    {
+        vbatAverage = vbatAverage + ((int32_t)(vbatSum - vbatAverage) >> smoothingShift);
+        tempAverage = tempAverage + ((int32_t)(tempSum - tempAverage) >> smoothingShift);
+        vrefAverage = vrefAverage + ((int32_t)(vrefSum - vrefAverage) >> smoothingShift);
+    }
+
+    uint16_t vbatMv = vbatToMv(vbatSum, vrefSum);
+
+    if (vbatLowMv == 0 || vbatMv < vbatLowMv)
+    {
+        vbatLowMv = vbatMv;
+    }
+}
+
+static const ADCConversionGroup adcGroup = {
+    .circular = true,
+    .num_channels = channelCount,
+    .end_cb = adcCallback,
+    .error_cb = nullptr,
+    .cfgr1 = ADC_CFGR1_CONT | ADC_CFGR1_RES_12BIT,
+    .tr = ADC_TR(0, 0),
+    // The temperature sensor needs at least 4us, this is 17us at 14MHz
+    .smpr = ADC_SMPR_SMP_239P5,
+    .chselr = ADC_CHSELR_CHSEL8 | ADC_CHSELR_CHSEL16 | ADC_CHSELR_CHSEL17,
+};
+
+void initSupplyMonitor()
+{
+    palSetLineMode(VBAT_SENSE_LINE, PAL_MODE_INPUT_ANALOG);
+
+    adcStart(&ADCD1, nullptr);
+    resumeSupplyMonitor();
+}
+
+void suspendSupplyMonitor()
+{
+    adcStopConversion(&ADCD1);
+
+    // The sensors draw current even with the ADC idle
+    adcSTM32SetCCR(0);
+}
+
+void resumeSupplyMonitor()
+{
+    adcSTM32SetCCR(ADC_CCR_VREFEN | ADC_CCR_TSEN);
+
+    // Start the averages over
+    vrefAverage = 0;
+    tempAverage = 0;
+    vbatAverage = 0;
+    vbatLowMv = 0;
+
+    // Runs until suspended, the DMA and callback do the rest
+    adcStartConversion(&ADCD1, &adcGroup, samples, bufferDepth);
+
+    lastReport = chVTGetSystemTimeX();
+}
+
+uint16_t getSupplyMv()
+{
+    return vrefToMv(vrefAverage);
+}
+
+uint16_t getVehicleMv()
+{
+    chSysLock();
+    uint32_t vbatSum = vbatAverage;
+    uint32_t vrefSum = vrefAverage;
+    chSysUnlock();
+
+    return vbatToMv(vbatSum, vrefSum);
+}
+
+int8_t getMcuTemperature()
+{
+    chSysLock();
+    uint32_t tempSum = tempAverage;
+    uint32_t vrefSum = vrefAverage;
+    chSysUnlock();
+
+    if (vrefSum == 0)
+    {
+        return 0;
+    }
+
+    // Scale the reading to what it would have been at the calibration voltage
+    int32_t ts = static_cast<int32_t>(tempSum * VREFINT_CAL / vrefSum);
+
+    return (ts - TS_CAL1) * (110 - 30) / (TS_CAL2 - TS_CAL1) + 30;
+}
+
+bool serviceSupplyReport()
+{
+    if (chTimeDiffX(lastReport, chVTGetSystemTimeX()) < reportInterval)
+    {
+        return false;
+    }
+
+    lastReport = chVTGetSystemTimeX();
+
+    chSysLock();
+    uint16_t minVehicleMv = vbatLowMv;
+    vbatLowMv = 0;
+    chSysUnlock();
+
+    uint16_t vehicleMv = getVehicleMv();
+    uint16_t supplyMv = getSupplyMv();
+    int8_t temperature = getMcuTemperature();
+
+    // Vehicle supply, its lowest since the last report, VDDA, then temperature in C
+    DiagPayload().U16(vehicleMv).U16(minVehicleMv).U16(supplyMv).U8(temperature).Send(DiagType::Supply);
+
+    return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+// Start sampling the vehicle supply, VREFINT and the temperature sensor in the background
+void initSupplyMonitor();
+
+// Stop sampling before STOP mode, and start again after
+void suspendSupplyMonitor();
+void resumeSupplyMonitor();
+
+// Averaged over the last few milliseconds. Supply is VDDA, the regulated
+// rail, vehicle is the 12V input before the regulator.
+uint16_t getSupplyMv();
+uint16_t getVehicleMv();
+int8_t getMcuTemperature();
+
+// Send the supply frame if it's due. Returns true if a frame was sent.
+bool serviceSupplyReport();
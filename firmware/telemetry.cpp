@@ -0,0 +1,156 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "telemetry.h"
+#include "framing.h"
+#include "spsc_ring.h"
+
+// USART1 TX on PA9, nothing to receive
+#define TELEMETRY_TX_LINE PAL_LINE(GPIOA, 9)
+static constexpr uint32_t telemetryBaud = 460800;
+
+// The main loop produces, the DMA consumes
+static SpscRing<uint8_t, 256> ring;
+
+// How much the DMA is sending right now, 0 if idle. Only touched with the system locked.
+static size_t dmaSize = 0;
+
+static uint16_t dropped = 0;
+
+// Send the longest run from the tail that doesn't wrap. Call with the system locked.
+static void startDmaI()
+{
+    const uint8_t* data;
+    dmaSize = ring.Contiguous(data);
+
+    if (dmaSize != 0)
+    {
+        uartStartSendI(&UARTD1, dmaSize, data);
+    }
+}
+
+static void txDone(UARTDriver*)
+{
+    chSysLockFromISR();
+
+    ring.Consume(dmaSize);
+    dmaSize = 0;
+
+    startDmaI();
+
+    chSysUnlockFromISR();
+}
+
+static const UARTConfig uartConfig = {
+    .txend1_cb = txDone,
+    .txend2_cb = nullptr,
+    .rxend_cb = nullptr,
+    .rxchar_cb = nullptr,
+    .rxerr_cb = nullptr,
+    .timeout_cb = nullptr,
+    .timeout = 0,
+    .speed = telemetryBaud,
+    .cr1 = 0,
+    .cr2 = 0,
+    .cr3 = 0,
+};
+
+void initTelemetry()
+{
+    palSetLineMode(TELEMETRY_TX_LINE, PAL_MODE_ALTERNATE(1));
+
+    uartStart(&UARTD1, &uartConfig);
+}
+
+static bool pushRecord(TelemetryType type, const uint8_t* payload, size_t size)
+{
+    // Type, payload, CRC
+    uint8_t record[1 + telemetryMaxPayload + 2];
+    record[0] = static_cast<uint8_t>(type);
+    for (size_t i = 0; i < size; i++)
+    {
+        record[1 + i] = payload[i];
+    }
+
+    size_t recordSize = 1 + size;
+    uint16_t crc = crc16(record, recordSize);
+    record[recordSize++] = crc & 0xFF;
+    record[recordSize++] = crc >> 8;
+
+    if (ring.Free() < cobsMaxEncodedSize(recordSize))
+    {
+        return false;
+    }
+
+    // COBS encode straight into the ring. The DMA can't see any of it until
+    // it's committed, so the code bytes can be patched in after.
+    size_t codeAt = 0;
+    size_t used = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < recordSize; i++)
+    {
+        if (record[i] == 0)
+        {
+            ring.Reserved(codeAt) = code;
+            codeAt = used++;
+            code = 1;
+            continue;
+        }
+
+        ring.Reserved(used++) = record[i];
+        code++;
+
+        if (code == 0xFF)
+        {
+            ring.Reserved(codeAt) = code;
+            codeAt = used++;
+            code = 1;
+        }
+    }
+
+    ring.Reserved(codeAt) = code;
+    ring.Reserved(used++) = 0;
+
+    ring.Commit(used);
+
+    return true;
+}
+
+void pushTelemetry(TelemetryType type, const uint8_t* payload, size_t size)
+{
+    if (size > telemetryMaxPayload)
+    {
+        return;
+    }
+
+    // Tell the other end what it missed, as soon as there's room to
+    if (dropped)
+    {
+        uint8_t count[2] = { static_cast<uint8_t>(dropped & 0xFF), static_cast<uint8_t>(dropped >> 8) };
+
+        if (pushRecord(TelemetryType::Dropped, count, sizeof(count)))
+        {
+            dropped = 0;
+        }
+    }
+
+    if (!pushRecord(type, payload, size))
+    {
+        if (dropped < UINT16_MAX)
+        {
+            dropped++;
+        }
+
+        return;
+    }
+
+    chSysLock();
+
+    if (dmaSize == 0)
+    {
+        startDmaI();
+    }
+
+    chSysUnlock();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary telemetry out the USART for bench debugging, see framing.h for the format
+enum class TelemetryType : uint8_t
+{
+    // uint16_t count of records dropped because the buffer was full
+    Dropped = 0,
+    // uint16_t microseconds per LoopPhase, in order, for one iteration
+    LoopTiming = 1,
+    // uint8_t wing, then Wing::RawInputs, low byte first. Sent on change.
+    ExpanderInputs = 2,
+    // uint8_t wing, uint8_t 1 if it answered its liveness check, then a bit per
+    // PCA9557 address that answered the last scan. Sent on change.
+    WingLink = 3,
+};
+
+static constexpr size_t telemetryMaxPayload = 32;
+
+void initTelemetry();
+
+// Queue a record to go out. Never blocks: if there isn't room, the record is
+// dropped and counted. Only call from the main thread.
+void pushTelemetry(TelemetryType type, const uint8_t* payload, size_t size);
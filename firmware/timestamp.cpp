@@ -0,0 +1,76 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "timestamp.h"
+
+#ifdef SWC_SIMULATOR
+#include "sim.h"
+#endif
+
+// TIM2 is the system tick, so TIM3 is ours. It runs at 1MHz and wraps
+// every 65.5ms, each wrap counts toward the upper 16 bits.
+static constexpr uint32_t timestampFrequency = 1'000'000;
+static constexpr uint32_t timestampIrqPriority = 2;
+
+static volatile uint16_t overflows = 0;
+
+CH_IRQ_HANDLER(STM32_TIM3_HANDLER)
+{
+    CH_IRQ_PROLOGUE();
+
+    TIM3->SR = ~TIM_SR_UIF;
+    overflows = overflows + 1;
+
+    CH_IRQ_EPILOGUE();
+}
+
+void initTimestamp()
+{
+    rccEnableTIM3(true);
+
+    TIM3->CR1 = 0;
+    TIM3->PSC = STM32_TIMCLK1 / timestampFrequency - 1;
+    TIM3->ARR = 0xFFFF;
+
+    // Load the prescaler, but don't count that as a wrap
+    TIM3->EGR = TIM_EGR_UG;
+    TIM3->SR = 0;
+    TIM3->DIER = TIM_DIER_UIE;
+
+    nvicEnableVector(STM32_TIM3_NUMBER, timestampIrqPriority);
+
+    TIM3->CR1 = TIM_CR1_CEN;
+}
+
+uint32_t getTimestampUs()
+{
+    syssts_t sts = chSysGetStatusAndLockX();
+
+    uint32_t high = overflows;
+    uint16_t low = TIM3->CNT;
+
+    // The counter wrapped but the interrupt hasn't run yet, either because
+    // we're in a critical section or it's only just happened. A small count
+    // means the wrap came before we read it.
+    if ((TIM3->SR & TIM_SR_UIF) && low < 0x8000)
+    {
+        high++;
+    }
+
+    chSysRestoreStatusX(sts);
+
+    return (high << 16) | low;
+}
+
+void waitUntilUs(uint32_t deadlineUs)
+{
+    while (static_cast<int32_t>(deadlineUs - getTimestampUs()) > 0)
+    {
+#ifdef SWC_SIMULATOR
+        // Simulated time only moves when told to
+        sim::advanceNs(1000);
+#else
+        __asm__ volatile ("nop");
+#endif
+    }
+}
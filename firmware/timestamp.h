@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Start the free running microsecond timer. Call before anything wants a timestamp.
+void initTimestamp();
+
+// Microseconds since initTimestamp, wrapping after ~71 minutes. Safe from
+// threads and ISRs. The timer is stopped along with its clock in STOP mode,
+// so time spent asleep doesn't count.
+uint32_t getTimestampUs();
+
+// Spin until getTimestampUs() reaches deadlineUs, for waits too short to
+// sleep through at the system tick. Returns straight away if it's passed.
+void waitUntilUs(uint32_t deadlineUs);
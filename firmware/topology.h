@@ -0,0 +1,20 @@
+#pragma once
+
+#include "wing.h"
+
+#include <array>
+#include <cstddef>
+
+// One wing on the board: where it is, and the status LED showing whether it's answering
+struct WingTopology
+{
+    WingBus bus;
+    ioline_t statusLed;
+};
+
+// The wings, in the order they appear in CAN frames. The table itself is in
+// main.cpp. Buttons and knobs for every wing share one 8 byte frame.
+static constexpr size_t wingCount = 2;
+static_assert(wingCount >= 1 && wingCount <= 4);
+
+using Wings = std::array<Wing, wingCount>;
@@ -0,0 +1,124 @@
+#include "ch.h"
+#include "hal.h"
+
+#include "watchdog.h"
+#include "report.h"
+
+// The longest loop iteration measured in the simulator is about 3.3ms, with
+// the bus slower than the real one. Give it plenty of margin, a hang still
+// gets the controls back in well under a tenth of a second.
+static constexpr uint32_t worstLoopUs = 4'000;
+static constexpr uint32_t watchdogTimeoutUs = 16 * worstLoopUs;
+
+// LSI is only 30-50kHz. Size the reload from the fast end so the timeout is
+// never shorter than asked for. At the slow end it's 5/3 as long.
+static constexpr uint32_t lsiMaxFrequency = 50'000;
+static constexpr uint32_t watchdogPrescaler = 32;
+static constexpr uint32_t watchdogReload = static_cast<uint64_t>(watchdogTimeoutUs) * lsiMaxFrequency / watchdogPrescaler / 1'000'000;
+
+static_assert(watchdogReload > 0 && watchdogReload <= 0xFFF, "watchdog timeout doesn't fit the IWDG reload");
+
+static const WDGConfig runningConfig = {
+    .pr = STM32_IWDG_PR_32,
+    .rlr = STM32_IWDG_RL(watchdogReload),
+    .winr = STM32_IWDG_WIN_DISABLED,
+};
+
+// Longest the IWDG can go, 21-35s depending on LSI
+static const WDGConfig sleepConfig = {
+    .pr = STM32_IWDG_PR_256,
+    .rlr = STM32_IWDG_RL(0xFFF),
+    .winr = STM32_IWDG_WIN_DISABLED,
+};
+
+static constexpr uint32_t sleepMagic = 0x51EE9ED0;
+
+// Survives the reset, see prepareWatchdogForSleep. Not zeroed at boot.
+__attribute__((section(".ram0")))
+static uint32_t sleepMarker;
+
+static ResetCause resetCause = ResetCause::Unknown;
+static uint8_t resetFlags = 0;
+static bool sleepWake = false;
+
+static ResetCause decodeResetCause(uint32_t csr)
+{
+    // The pin flag is set by every internal reset too, so it comes last
+    if (csr & RCC_CSR_IWDGRSTF)
+    {
+        return ResetCause::IndependentWatchdog;
+    }
+    else if (csr & RCC_CSR_WWDGRSTF)
+    {
+        return ResetCause::WindowWatchdog;
+    }
+    else if (csr & RCC_CSR_LPWRRSTF)
+    {
+        return ResetCause::LowPower;
+    }
+    else if (csr & RCC_CSR_SFTRSTF)
+    {
+        return ResetCause::Software;
+    }
+    else if (csr & RCC_CSR_OBLRSTF)
+    {
+        return ResetCause::OptionByteLoad;
+    }
+    else if (csr & RCC_CSR_PORRSTF)
+    {
+        return ResetCause::PowerOn;
+    }
+    else if (csr & RCC_CSR_PINRSTF)
+    {
+        return ResetCause::Pin;
+    }
+
+    return ResetCause::Unknown;
+}
+
+void initWatchdog()
+{
+    uint32_t csr = RCC->CSR;
+    RCC->CSR |= RCC_CSR_RMVF;
+
+    resetCause = decodeResetCause(csr);
+    resetFlags = csr >> 24;
+
+    sleepWake = resetCause == ResetCause::IndependentWatchdog && sleepMarker == sleepMagic;
+    sleepMarker = 0;
+
+    wdgStart(&WDGD1, sleepWake ? &sleepConfig : &runningConfig);
+}
+
+ResetCause getResetCause()
+{
+    return resetCause;
+}
+
+bool isWatchdogSleepWake()
+{
+    return sleepWake;
+}
+
+void kickWatchdog()
+{
+    wdgReset(&WDGD1);
+}
+
+void prepareWatchdogForSleep()
+{
+    wdgStart(&WDGD1, &sleepConfig);
+    sleepMarker = sleepMagic;
+}
+
+void resumeWatchdog()
+{
+    sleepMarker = 0;
+    wdgStart(&WDGD1, &runningConfig);
+}
+
+void sendResetCause()
+{
+    // Cause, the raw RCC_CSR flags, and whether it was the watchdog waking us from sleep
+    DiagPayload().U8(static_cast<uint8_t>(resetCause)).U8(resetFlags).U8(sleepWake).Send(DiagType::ResetCause);
+}
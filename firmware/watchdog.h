@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+// Why we last came out of reset, from the RCC flags
+enum class ResetCause : uint8_t
+{
+    Unknown,
+    PowerOn,
+    Pin,
+    Software,
+    IndependentWatchdog,
+    WindowWatchdog,
+    LowPower,
+    OptionByteLoad,
+};
+
+// Latch and clear the reset cause, then start the watchdog. Call first thing after chSysInit.
+void initWatchdog();
+
+ResetCause getResetCause();
+
+// True if the last reset was the watchdog going off while we were asleep in
+// STOP, rather than a hang. Nobody needs the controls, so go back to sleep.
+bool isWatchdogSleepWake();
+
+// Only call this once a full loop has gone by without trouble
+void kickWatchdog();
+
+// The watchdog can't be stopped and keeps running in STOP, so before sleeping
+// stretch it as long as it goes. It resets us out of sleep once in a while,
+// and isWatchdogSleepWake tells that apart from a hang.
+void prepareWatchdogForSleep();
+
+// Back to the normal timeout after waking
+void resumeWatchdog();
+
+// Report the reset cause on the diagnostic ID
+void sendResetCause();
@@ -1,88 +1,234 @@
 #include "hal.h"
 
 #include "wing.h"
+#include "wing_layout.h"
+#include "timestamp.h"
 
-Wing::Wing(ioline_t scl, ioline_t sda)
-    : m_scl(scl)
-    , m_sda(sda)
-{
-}
+#include <array>
+#include <bit>
 
-static constexpr bool getbit(uint8_t val, uint8_t bit)
+Wing::Wing(const WingBus& bus)
+    : m_scl(bus.scl)
+    , m_sda(bus.sda)
 {
-    return (val >> bit) & 0x1;
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        m_expanders[chip] = bus.expanders[chip];
+    }
 }
 
-static constexpr uint8_t pack(uint8_t num)
-{
-    return num;
-}
+using namespace WingLayout;
 
-static constexpr uint8_t pack(uint8_t num, bool b)
+static constexpr auto chipConfigs = []()
 {
-    return (num << 1) | (b ? 1 : 0);
-}
+    std::array<uint8_t, wingChipCount> configs{};
+
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        configs[chip] = ChipConfig(chip);
+    }
+
+    return configs;
+}();
 
-template<typename... Ts>
-static constexpr uint8_t pack(uint8_t num, bool b, Ts... args)
+static constexpr uint8_t ledChips = ChipsWith(PinRole::Led);
+static constexpr uint8_t buttonChips = ChipsWith(PinRole::Button);
+
+// RawInputs has a byte for each chip with buttons
+static_assert(std::popcount(buttonChips) * 8 <= 8 * sizeof(uint16_t), "button chips' inputs don't fit in RawInputs");
+
+// Registers Scrub checks on each chip, in order
+static constexpr Pca9557::Opcode scrubRegisters[] =
 {
-    uint8_t val = pack(num, b);
-    return pack(val, args...);
-}
+    Pca9557::Opcode::Configuration,
+    Pca9557::Opcode::PolarityInversion,
+    Pca9557::Opcode::Output,
+};
+
+static constexpr size_t scrubSteps = wingChipCount * std::size(scrubRegisters);
+
+// One register every few loops goes through every chip in well under 100ms.
+// Corruption is rare, the bus time is better spent on buttons.
+static constexpr uint8_t scrubInterval = 4;
 
 void Wing::Init()
 {
-    BitbangI2c bus(m_scl, m_sda);
-
-    // Invert no pins
-    Pca9557::SetInvert(bus, 0, 0);
-    Pca9557::SetInvert(bus, 1, 0);
-    Pca9557::SetInvert(bus, 2, 0);
+    m_wasAlive = Discover();
 
-    // Chip 1:
-    // Bits 4, 7 are LEDs
-    // Bits 0-3 are knob
-    // Bits 5, 6 are buttons
-    uint8_t c1cfg = pack(0, 1, 1, 0, 1, 1, 1, 1);
+    Configure();
+}
 
-    // Chip 2:
-    // All bits are knob
-    uint8_t c2cfg = pack(1, 1, 1, 1, 1, 1, 1, 1);
+void Wing::Configure()
+{
+    BitbangI2c bus(m_scl, m_sda, &m_linkStats);
 
-    // Chip 3:
-    // Bits 1, 2, 7 are LEDs
-    // Bits 0, 3, 6 are buttons
-    uint8_t c3cfg = pack(0, 1, 1, 1, 1, 0, 0, 1);
+    // Invert no pins
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if (m_activeChips & (1 << chip))
+        {
+            Pca9557::SetInvert(bus, m_expanders[chip], 0);
+        }
+    }
 
-    Pca9557::Configure(bus, 0, c1cfg);
-    Pca9557::Configure(bus, 1, c2cfg);
-    Pca9557::Configure(bus, 2, c3cfg);
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if (m_activeChips & (1 << chip))
+        {
+            Pca9557::Configure(bus, m_expanders[chip], chipConfigs[chip]);
+        }
+    }
 
     // Turn off all the LEDs
+    m_ledsValid = false;
     WriteLeds(0);
+
+    m_readFailed = false;
 }
 
-bool Wing::CheckAlive()
+bool Wing::Discover()
 {
-    BitbangI2c bus(m_scl, m_sda);
+    BitbangI2c bus(m_scl, m_sda, &m_linkStats);
 
-    auto readBefore = Pca9557::GetInvert(bus, 2);
+    m_found = 0;
 
-    // Toggle an invert bit for an unused channel
-    auto expect = readBefore ^ 0x10;
-    Pca9557::SetInvert(bus, 2, expect);
+    for (uint8_t offset = 0; offset < Pca9557::addressCount; offset++)
+    {
+        if (Pca9557::Probe(bus, offset))
+        {
+            m_found |= 1 << offset;
+        }
+    }
+
+    m_activeChips = 0;
 
-    // Check that the bit changed!
-    return expect == Pca9557::GetInvert(bus, 2);
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if (m_found & (1 << m_expanders[chip]))
+        {
+            m_activeChips |= 1 << chip;
+        }
+    }
+
+    return m_activeChips != 0;
+}
+
+bool Wing::Scrub()
+{
+    for (size_t i = 0; i < scrubSteps; i++)
+    {
+        size_t chip = m_scrubStep / std::size(scrubRegisters);
+        auto reg = scrubRegisters[m_scrubStep % std::size(scrubRegisters)];
+
+        m_scrubStep = (m_scrubStep + 1) % scrubSteps;
+
+        if (!(m_activeChips & (1 << chip)))
+        {
+            // Once a pass, see if a chip Discover missed has turned up
+            if (reg != Pca9557::Opcode::Configuration)
+            {
+                continue;
+            }
+
+            BitbangI2c bus(m_scl, m_sda, &m_linkStats);
+
+            if (Pca9557::Probe(bus, m_expanders[chip]))
+            {
+                Pca9557::SetInvert(bus, m_expanders[chip], 0);
+                Pca9557::Configure(bus, m_expanders[chip], chipConfigs[chip]);
+
+                m_activeChips |= 1 << chip;
+                m_found |= 1 << m_expanders[chip];
+
+                // Its outputs are whatever it powered up with, have WriteLeds set them all
+                m_ledsValid = false;
+            }
+
+            return true;
+        }
+
+        uint8_t expected;
+
+        switch (reg)
+        {
+            case Pca9557::Opcode::Configuration:
+                expected = chipConfigs[chip];
+                break;
+            case Pca9557::Opcode::Output:
+                // Only the LED chips drive anything, and only once WriteLeds has been
+                if (!(ledChips & (1 << chip)) || !m_ledsValid)
+                {
+                    continue;
+                }
+
+                expected = m_ledOutputs[chip];
+                break;
+            default:
+                expected = 0;
+                break;
+        }
+
+        BitbangI2c bus(m_scl, m_sda, &m_linkStats);
+
+        uint8_t actual;
+        if (!Pca9557::ReadRegister(bus, m_expanders[chip], reg, actual))
+        {
+            return false;
+        }
+
+        if (actual != expected)
+        {
+            Pca9557::WriteRegister(bus, m_expanders[chip], reg, expected);
+
+            if (m_corrections[chip] != UINT16_MAX)
+            {
+                m_corrections[chip]++;
+            }
+        }
+
+        return true;
+    }
+
+    // Nothing to check
+    return true;
 }
 
 bool Wing::CheckAliveAndReinit()
 {
-    bool alive = CheckAlive();
+    bool alive;
 
-    if (alive && !m_wasAlive)
+    if (m_wasAlive)
     {
-        Init();
+        alive = !m_readFailed;
+
+        if (alive && ++m_scrubDelay >= scrubInterval)
+        {
+            m_scrubDelay = 0;
+            alive = Scrub();
+        }
+
+        if (!alive)
+        {
+            m_dropouts++;
+            m_droppedOut = true;
+        }
+    }
+    else
+    {
+        // Gone (or never there): find out what's fitted now, and set it up if anything is
+        alive = Discover();
+
+        if (alive)
+        {
+            Configure();
+
+            // Coming back from sleep isn't a reinit
+            if (m_droppedOut)
+            {
+                m_reinits++;
+                m_droppedOut = false;
+            }
+        }
     }
 
     m_wasAlive = alive;
@@ -90,43 +236,112 @@ bool Wing::CheckAliveAndReinit()
     return alive;
 }
 
+void Wing::Sleep()
+{
+    WriteLeds(0);
+
+    BitbangI2c bus(m_scl, m_sda, &m_linkStats);
+
+    // Power-on default: all pins are inputs
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if (m_activeChips & (1 << chip))
+        {
+            Pca9557::Configure(bus, m_expanders[chip], 0xFF);
+        }
+    }
+
+    m_wasAlive = false;
+    m_ledsValid = false;
+}
+
 void Wing::WriteLeds(uint8_t leds)
 {
-    bool l1 = getbit(leds, 0);
-    bool l2 = getbit(leds, 1);
-    bool l3 = getbit(leds, 2);
-    bool l4 = getbit(leds, 3);
-    bool l5 = getbit(leds, 4);
+    uint8_t outputs[wingChipCount];
+    ScatterAll<PinRole::Led>(leds, outputs);
+
+    uint8_t changed = 0;
 
-    //          bit 7  6  5   4  3   2   1  0
-    auto c1 = pack(l2, 0, 0, l1, 0,  0,  0, 0);
-    auto c3 = pack(l4, 0, 0,  0, 0, l5, l3, 0);
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if ((ledChips & m_activeChips & (1 << chip)) && (!m_ledsValid || outputs[chip] != m_ledOutputs[chip]))
+        {
+            changed |= 1 << chip;
+        }
+    }
 
-    BitbangI2c bus(m_scl, m_sda);
-    Pca9557::Write(bus, 0, c1);
-    Pca9557::Write(bus, 2, c3);
+    if (!changed)
+    {
+        return;
+    }
+
+    BitbangI2c bus(m_scl, m_sda, &m_linkStats);
+
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if (changed & (1 << chip))
+        {
+            Pca9557::Write(bus, m_expanders[chip], outputs[chip]);
+            m_ledOutputs[chip] = outputs[chip];
+        }
+    }
+
+    m_ledsValid = true;
 }
 
 uint8_t Wing::ReadButtons()
 {
-    BitbangI2c bus(m_scl, m_sda);
+    BitbangI2c bus(m_scl, m_sda, &m_linkStats);
+
+    uint8_t inputs[wingChipCount] = {};
 
-    uint8_t c1 = Pca9557::Read(bus, 0);
-    uint8_t c3 = Pca9557::Read(bus, 2);
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if (buttonChips & m_activeChips & (1 << chip))
+        {
+            // A chip that stops answering is how a dead wing shows up
+            if (!Pca9557::ReadRegister(bus, m_expanders[chip], Pca9557::Opcode::Input, inputs[chip]))
+            {
+                m_readFailed = true;
+            }
+        }
+    }
 
-    bool b1 = getbit(c1, 5);
-    bool b2 = getbit(c1, 6);
-    bool b3 = getbit(c3, 0);
-    bool b4 = getbit(c3, 6);
-    bool b5 = getbit(c3, 3);
+    // Just the input pins, a byte per button chip from the low byte up
+    uint16_t rawInputs = 0;
+    size_t shift = 0;
 
-    return pack(b5, b4, b3, b2, b1);
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        if (buttonChips & (1 << chip))
+        {
+            rawInputs |= (inputs[chip] & chipConfigs[chip]) << shift;
+            shift += 8;
+        }
+    }
+
+    m_rawInputs = rawInputs;
+
+    m_buttons = GatherAll<PinRole::Button>(inputs);
+    return m_buttons;
 }
 
 uint8_t Wing::ReadKnob()
 {
     // TODO: implement
-    return 0;
+    m_knob = 0;
+    return m_knob;
+}
+
+void Wing::PublishState()
+{
+    WingState state;
+    state.buttons = m_buttons;
+    state.knob = m_knob;
+    state.alive = m_wasAlive;
+    state.timestampUs = getTimestampUs();
+
+    m_state.Write(state);
 }
 
 namespace Pca9557
@@ -134,15 +349,6 @@ namespace Pca9557
 // PCA9557 - 8.3.2.1
 static constexpr uint8_t baseAddress = 0x18;
 
-// PCA9557 - 8.3.2.2
-enum class Opcode : uint8_t
-{
-    Input = 0x00,
-    Output = 0x01,
-    PolarityInversion = 0x02,
-    Configuration = 0x03,
-};
-
 static void DoWrite(BitbangI2c& i2c, uint8_t offset, Opcode op, uint8_t data)
 {
     auto addr = baseAddress + offset;
@@ -157,6 +363,21 @@ static uint8_t DoRead(BitbangI2c& i2c, uint8_t offset, Opcode op)
     return i2c.readRegister(addr, (uint8_t)op);
 }
 
+bool Probe(BitbangI2c& i2c, uint8_t offset)
+{
+    return i2c.probe(baseAddress + offset);
+}
+
+bool ReadRegister(BitbangI2c& i2c, uint8_t offset, Opcode op, uint8_t& value)
+{
+    return i2c.readRegister(baseAddress + offset, (uint8_t)op, value);
+}
+
+void WriteRegister(BitbangI2c& i2c, uint8_t offset, Opcode op, uint8_t value)
+{
+    DoWrite(i2c, offset, op, value);
+}
+
 uint8_t Read(BitbangI2c& i2c, uint8_t offset)
 {
     return DoRead(i2c, offset, Opcode::Input);
@@ -1,31 +1,162 @@
 #pragma once
 
 #include "i2c_bb.h"
+#include "seqlock.h"
+#include "wing_layout.h"
+
+#include <array>
+
+// Expanders strapped to consecutive addresses from the base, in chip order
+constexpr std::array<uint8_t, wingChipCount> consecutiveExpanders()
+{
+    std::array<uint8_t, wingChipCount> offsets{};
+
+    for (size_t chip = 0; chip < wingChipCount; chip++)
+    {
+        offsets[chip] = chip;
+    }
+
+    return offsets;
+}
+
+// Where a wing's expanders are: its bus, and the offset of each expander from
+// the PCA9557 base address, in wing_layout.h chip order
+struct WingBus
+{
+    ioline_t scl;
+    ioline_t sda;
+    std::array<uint8_t, wingChipCount> expanders = consecutiveExpanders();
+};
+
+// Everything one poll of a wing found, published as one piece
+struct WingState
+{
+    uint8_t buttons;
+    uint8_t knob;
+    bool alive;
+    // getTimestampUs() when published
+    uint32_t timestampUs;
+};
 
 class Wing
 {
 public:
-    Wing(ioline_t scl, ioline_t sda);
+    Wing(const WingBus& bus);
+
+    // Find which expanders are fitted, then configure them
     void Init();
 
-    // Returns true if the wing responds
-    bool CheckAlive();
+    // Probe every PCA9557 address on the bus. Only the expanders that answer
+    // are touched from then on. Returns true if any of the wing's expanders did.
+    bool Discover();
 
+    // Check one configuration, polarity or output register against what we
+    // set it to, and rewrite it if it changed. A chip Discover missed gets
+    // probed instead, and configured if it answers. Each call moves on to the
+    // next. Returns false if an active chip didn't answer.
+    bool Scrub();
+
+    // A wing is alive while ReadButtons and the scrubber are answered. Once
+    // it isn't, this scans for it every call and configures it on its return.
     bool CheckAliveAndReinit();
 
+    // Turn off the LEDs and return every expander pin to an input, as
+    // before power-on init. The next CheckAliveAndReinit runs a full Init.
+    void Sleep();
+
     uint8_t ReadButtons();
     uint8_t ReadKnob();
+
+    // Publish what the last CheckAliveAndReinit, ReadButtons and ReadKnob found.
+    // Only call from the context that polls the wing.
+    void PublishState();
+
+    // A consistent snapshot of the last published state, safe from any context
+    WingState GetState() const { return m_state.Read(); }
+
+    // Bit n set if the PCA9557 at offset n answered the last Discover (or a
+    // scrub probe since), whether or not the wing uses it
+    uint8_t ExpandersFound() const { return m_found; }
+
+    // How many registers Scrub has had to rewrite on a chip, saturating
+    uint16_t Corrections(size_t chip) const { return m_corrections[chip]; }
+
+    // The wing's bus, since boot
+    const I2cStats& LinkStats() const { return m_linkStats; }
+
+    // Times the wing stopped answering, and times it was set up again on its return
+    uint32_t Dropouts() const { return m_dropouts; }
+    uint32_t Reinits() const { return m_reinits; }
+
+    // The input pins ReadButtons last read, a byte per chip with buttons,
+    // the lowest numbered chip in the low byte
+    uint16_t RawInputs() const { return m_rawInputs; }
+
+    // Expander writes are skipped if the LEDs are unchanged since the last call
     void WriteLeds(uint8_t);
 
 private:
+    // Set up the chips Discover found, and turn off the LEDs
+    void Configure();
+
     ioline_t m_scl;
     ioline_t m_sda;
+    uint8_t m_expanders[wingChipCount];
+
+    I2cStats m_linkStats = {};
+    uint32_t m_dropouts = 0;
+    uint32_t m_reinits = 0;
+
+    // Bit n set if layout chip n answered the last Discover
+    uint8_t m_activeChips = 0;
+    uint8_t m_found = 0;
 
     bool m_wasAlive = false;
+    // Set when the wing stops answering, cleared once it's set up again
+    bool m_droppedOut = false;
+
+    // Set if a chip didn't answer ReadButtons
+    bool m_readFailed = false;
+
+    // Calls to CheckAliveAndReinit since the last Scrub, and what it checks next
+    uint8_t m_scrubDelay = 0;
+    uint8_t m_scrubStep = 0;
+    uint16_t m_corrections[wingChipCount] = {};
+
+    // What we last wrote to the output register of each chip with LEDs
+    bool m_ledsValid = false;
+    uint8_t m_ledOutputs[wingChipCount] = {};
+
+    uint16_t m_rawInputs = 0;
+
+    uint8_t m_buttons = 0;
+    uint8_t m_knob = 0;
+    Seqlock<WingState> m_state;
 };
 
 namespace Pca9557
 {
+    // A0-A2 give eight addresses
+    static constexpr uint8_t addressCount = 8;
+
+    // PCA9557 - 8.3.2.2
+    enum class Opcode : uint8_t
+    {
+        Input = 0x00,
+        Output = 0x01,
+        PolarityInversion = 0x02,
+        Configuration = 0x03,
+    };
+
+    // Read any register, returns false if the chip didn't acknowledge
+    bool ReadRegister(BitbangI2c& i2c, uint8_t offset, Opcode op, uint8_t& value);
+
+    // Write any register
+    void WriteRegister(BitbangI2c& i2c, uint8_t offset, Opcode op, uint8_t value);
+
+    // Returns true if the chip acknowledges its address
+    bool Probe(BitbangI2c& i2c, uint8_t offset);
+
     // Reads the true state of each pin, whether an input or output.
     uint8_t Read(BitbangI2c& i2c, uint8_t offset);
 
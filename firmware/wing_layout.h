@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+// How a wing is wired: which expander pin each logical signal is on. This
+// table is the only place that knows. The expander configuration and the
+// code moving bits between logical and expander order are generated from it.
+
+enum class PinRole : uint8_t
+{
+    // Output, LED n of WriteLeds
+    Led,
+    // Input, bit n of ReadButtons
+    Button,
+    // Input, bit n of the knob position. Only used for ChipConfig: the knob
+    // is wider than a byte, so it has no Scatter/Gather moves.
+    Knob,
+};
+
+struct PinMap
+{
+    PinRole role;
+    uint8_t index;
+    // Layout chip index, WingBus::expanders says which address each is at
+    uint8_t chip;
+    uint8_t bit;
+};
+
+static constexpr size_t wingChipCount = 3;
+
+inline constexpr PinMap wingLayout[] = {
+    { PinRole::Led, 0, 0, 4 },
+    { PinRole::Led, 1, 0, 7 },
+    { PinRole::Led, 2, 2, 1 },
+    { PinRole::Led, 3, 2, 7 },
+    { PinRole::Led, 4, 2, 2 },
+
+    { PinRole::Button, 0, 0, 5 },
+    { PinRole::Button, 1, 0, 6 },
+    { PinRole::Button, 2, 2, 0 },
+    { PinRole::Button, 3, 2, 6 },
+    { PinRole::Button, 4, 2, 3 },
+
+    // The knob rows only feed ChipConfig, to make their pins inputs
+    { PinRole::Knob, 0, 0, 0 },
+    { PinRole::Knob, 1, 0, 1 },
+    { PinRole::Knob, 2, 0, 2 },
+    { PinRole::Knob, 3, 0, 3 },
+    { PinRole::Knob, 4, 1, 0 },
+    { PinRole::Knob, 5, 1, 1 },
+    { PinRole::Knob, 6, 1, 2 },
+    { PinRole::Knob, 7, 1, 3 },
+    { PinRole::Knob, 8, 1, 4 },
+    { PinRole::Knob, 9, 1, 5 },
+    { PinRole::Knob, 10, 1, 6 },
+    { PinRole::Knob, 11, 1, 7 },
+
+    // Chip 2 bits 4, 5 are unused, left as inputs.
+};
+
+namespace WingLayout
+{
+
+// Configuration register for a chip: LEDs are outputs (0), everything else an input (1)
+constexpr uint8_t ChipConfig(size_t chip)
+{
+    uint8_t config = 0xFF;
+
+    for (const auto& pin : wingLayout)
+    {
+        if (pin.chip == chip && pin.role == PinRole::Led)
+        {
+            config &= ~(1 << pin.bit);
+        }
+    }
+
+    return config;
+}
+
+// Bit n set if chip n has any pin with this role
+constexpr uint8_t ChipsWith(PinRole role)
+{
+    uint8_t chips = 0;
+
+    for (const auto& pin : wingLayout)
+    {
+        if (pin.role == role)
+        {
+            chips |= 1 << pin.chip;
+        }
+    }
+
+    return chips;
+}
+
+// Bits in the logical value for a role: LEDs and buttons are a byte, the knob 12 bits
+constexpr size_t RoleWidth(PinRole role)
+{
+    return role == PinRole::Knob ? 12 : 8;
+}
+
+// Every signal is on one pin, and every pin has at most one signal
+constexpr bool IsValid()
+{
+    for (size_t i = 0; i < std::size(wingLayout); i++)
+    {
+        const auto& a = wingLayout[i];
+
+        if (a.chip >= wingChipCount || a.bit >= 8 || a.index >= RoleWidth(a.role))
+        {
+            return false;
+        }
+
+        for (size_t j = i + 1; j < std::size(wingLayout); j++)
+        {
+            const auto& b = wingLayout[j];
+
+            if ((a.chip == b.chip && a.bit == b.bit) || (a.role == b.role && a.index == b.index))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static_assert(IsValid(), "wing layout has a pin or signal listed twice, or out of range");
+
+// One shift and mask, moving any number of bits that all move the same distance
+struct BitMove
+{
+    int8_t shift;
+    // Which bits to keep, after shifting
+    uint8_t mask;
+};
+
+struct BitMoves
+{
+    BitMove moves[8];
+    size_t count;
+};
+
+// Group the pins for a role on a chip by how far they move, one BitMove per
+// distance. To the chip (scatter) the shift is bit - index, from it (gather)
+// index - bit.
+constexpr BitMoves Moves(size_t chip, PinRole role, bool toChip)
+{
+    BitMoves result{};
+
+    for (const auto& pin : wingLayout)
+    {
+        if (pin.chip != chip || pin.role != role)
+        {
+            continue;
+        }
+
+        int8_t shift = toChip ? pin.bit - pin.index : pin.index - pin.bit;
+        uint8_t dest = toChip ? pin.bit : pin.index;
+
+        size_t i = 0;
+        while (i < result.count && result.moves[i].shift != shift)
+        {
+            i++;
+        }
+
+        if (i == result.count)
+        {
+            result.moves[result.count++] = { shift, 0 };
+        }
+
+        result.moves[i].mask |= 1 << dest;
+    }
+
+    return result;
+}
+
+template<size_t Chip, PinRole Role, bool ToChip>
+inline constexpr BitMoves moves = Moves(Chip, Role, ToChip);
+
+// The masks are a byte, so only the byte-wide roles can be moved
+template<PinRole Role>
+inline constexpr bool movable = RoleWidth(Role) <= 8;
+
+template<int8_t Shift>
+constexpr uint8_t ShiftBy(uint8_t value)
+{
+    if constexpr (Shift >= 0)
+    {
+        return value << Shift;
+    }
+    else
+    {
+        return value >> -Shift;
+    }
+}
+
+// Expands to nothing but the shifts and masks for one chip
+template<size_t Chip, PinRole Role, bool ToChip, size_t I = 0>
+constexpr uint8_t Move(uint8_t value)
+{
+    static_assert(movable<Role>, "the knob is wider than a byte, it can't be scattered or gathered");
+
+    constexpr const BitMoves& m = moves<Chip, Role, ToChip>;
+
+    if constexpr (I == m.count)
+    {
+        return 0;
+    }
+    else
+    {
+        return (ShiftBy<m.moves[I].shift>(value) & m.moves[I].mask)
+            | Move<Chip, Role, ToChip, I + 1>(value);
+    }
+}
+
+// Logical signals to the output register of a chip
+template<size_t Chip, PinRole Role>
+constexpr uint8_t Scatter(uint8_t logical)
+{
+    return Move<Chip, Role, true>(logical);
+}
+
+// The input register of a chip to logical signals
+template<size_t Chip, PinRole Role>
+constexpr uint8_t Gather(uint8_t input)
+{
+    return Move<Chip, Role, false>(input);
+}
+
+template<PinRole Role, size_t... Chip>
+constexpr void ScatterChips(uint8_t logical, uint8_t (&outputs)[wingChipCount], std::index_sequence<Chip...>)
+{
+    ((outputs[Chip] = Scatter<Chip, Role>(logical)), ...);
+}
+
+template<PinRole Role, size_t... Chip>
+constexpr uint8_t GatherChips(const uint8_t (&inputs)[wingChipCount], std::index_sequence<Chip...>)
+{
+    return (0 | ... | Gather<Chip, Role>(inputs[Chip]));
+}
+
+// Logical signals to the output register of every chip
+template<PinRole Role>
+constexpr void ScatterAll(uint8_t logical, uint8_t (&outputs)[wingChipCount])
+{
+    ScatterChips<Role>(logical, outputs, std::make_index_sequence<wingChipCount>());
+}
+
+// The input registers of every chip to logical signals. Chips with no pin
+// for the role are never looked at.
+template<PinRole Role>
+constexpr uint8_t GatherAll(const uint8_t (&inputs)[wingChipCount])
+{
+    return GatherChips<Role>(inputs, std::make_index_sequence<wingChipCount>());
+}
+
+}